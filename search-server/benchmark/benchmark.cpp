@@ -0,0 +1,387 @@
+#include "../process_queries.h"
+#include "../metrics.h"
+#include "../remove_duplicates.h"
+#include "../search_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Runs every operation against a generated corpus and prints latency percentiles and
+// throughput as JSON. The same options and seed always produce the same corpus and queries,
+// so the output of two builds can be diffed.
+//
+// Options, all given as --name=value:
+//   documents, vocabulary, max_word_length, document_words, query_words, queries,
+//   zipf (skew of word frequencies, 0 is uniform), minus_probability, duplicate_fraction,
+//   remove_fraction, match_queries, batch_repeats, seed, output (file, stdout by default)
+
+struct Options {
+    int documents = 10'000;
+    int vocabulary = 1'000;
+    int max_word_length = 10;
+    int document_words = 70;
+    int query_words = 7;
+    int queries = 2'000;
+    double zipf = 1.0;
+    double minus_probability = 0.1;
+    double duplicate_fraction = 0.05;
+    double remove_fraction = 0.1;
+    int match_queries = 20;
+    int batch_repeats = 5;
+    uint64_t seed = 42;
+    string output;
+};
+
+Options ParseOptions(int argc, char** argv) {
+    map<string, string> values;
+    for (int i = 1; i < argc; ++i) {
+        const string_view argument = argv[i];
+        const size_t equals = argument.find('=');
+        if (argument.substr(0, 2) != "--"sv || equals == argument.npos) {
+            throw invalid_argument("Expected --name=value, got "s + string(argument));
+        }
+        values[string(argument.substr(2, equals - 2))] = string(argument.substr(equals + 1));
+    }
+    Options options;
+    const auto read = [&values](const string& name, auto& value) {
+        const auto it = values.find(name);
+        if (it == values.end()) {
+            return;
+        }
+        istringstream in(it->second);
+        if (!(in >> value)) {
+            throw invalid_argument("Bad value of --"s + name);
+        }
+        values.erase(it);
+    };
+    read("documents", options.documents);
+    read("vocabulary", options.vocabulary);
+    read("max_word_length", options.max_word_length);
+    read("document_words", options.document_words);
+    read("query_words", options.query_words);
+    read("queries", options.queries);
+    read("zipf", options.zipf);
+    read("minus_probability", options.minus_probability);
+    read("duplicate_fraction", options.duplicate_fraction);
+    read("remove_fraction", options.remove_fraction);
+    read("match_queries", options.match_queries);
+    read("batch_repeats", options.batch_repeats);
+    read("seed", options.seed);
+    read("output", options.output);
+    if (!values.empty()) {
+        throw invalid_argument("Unknown option --"s + values.begin()->first);
+    }
+    return options;
+}
+
+// Draws word ranks with probability proportional to 1 / (rank + 1)^skew
+class ZipfDistribution {
+public:
+    ZipfDistribution(int size, double skew) {
+        cumulative_.reserve(size);
+        double total = 0.0;
+        for (int rank = 0; rank < size; ++rank) {
+            total += 1.0 / pow(rank + 1.0, skew);
+            cumulative_.push_back(total);
+        }
+    }
+
+    int operator()(mt19937_64& generator) const {
+        const double value = uniform_real_distribution<double>(0.0, cumulative_.back())(generator);
+        const auto it = upper_bound(cumulative_.begin(), cumulative_.end(), value);
+        return static_cast<int>(min<ptrdiff_t>(it - cumulative_.begin(), cumulative_.size() - 1));
+    }
+
+private:
+    vector<double> cumulative_;
+};
+
+vector<string> GenerateVocabulary(mt19937_64& generator, const Options& options) {
+    vector<string> words;
+    words.reserve(options.vocabulary);
+    while (static_cast<int>(words.size()) < options.vocabulary) {
+        const int length = uniform_int_distribution(1, options.max_word_length)(generator);
+        string word;
+        for (int i = 0; i < length; ++i) {
+            word.push_back(uniform_int_distribution('a', 'z')(generator));
+        }
+        words.push_back(move(word));
+    }
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    shuffle(words.begin(), words.end(), generator);
+    return words;
+}
+
+string GenerateText(mt19937_64& generator, const vector<string>& vocabulary, const ZipfDistribution& zipf,
+    int word_count, double minus_probability) {
+    string text;
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        if (minus_probability > 0 && uniform_real_distribution<>(0, 1)(generator) < minus_probability) {
+            text.push_back('-');
+        }
+        text += vocabulary[zipf(generator)];
+    }
+    return text;
+}
+
+struct OperationStats {
+    string name;
+    vector<int64_t> latencies_ns;
+    int64_t items = 0; // documents or queries processed, for throughput
+};
+
+class Stopwatch {
+public:
+    int64_t ElapsedNs() const {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    chrono::steady_clock::time_point start_ = chrono::steady_clock::now();
+};
+
+template <typename Function>
+void Measure(OperationStats& stats, int64_t items, Function function) {
+    const Stopwatch stopwatch;
+    function();
+    stats.latencies_ns.push_back(stopwatch.ElapsedNs());
+    stats.items += items;
+}
+
+double GetPercentileUs(const vector<int64_t>& sorted_latencies, double percentile) {
+    if (sorted_latencies.empty()) {
+        return 0.0;
+    }
+    const size_t rank = static_cast<size_t>(ceil(percentile / 100.0 * sorted_latencies.size()));
+    return sorted_latencies[min(sorted_latencies.size(), max<size_t>(rank, 1)) - 1] / 1000.0;
+}
+
+void PrintJson(ostream& out, const Options& options, vector<OperationStats>& operations, double checksum) {
+    out << fixed << setprecision(3);
+    out << "{\n";
+    out << "  \"config\": {\n";
+    out << "    \"documents\": " << options.documents << ",\n";
+    out << "    \"vocabulary\": " << options.vocabulary << ",\n";
+    out << "    \"max_word_length\": " << options.max_word_length << ",\n";
+    out << "    \"document_words\": " << options.document_words << ",\n";
+    out << "    \"query_words\": " << options.query_words << ",\n";
+    out << "    \"queries\": " << options.queries << ",\n";
+    out << "    \"zipf\": " << options.zipf << ",\n";
+    out << "    \"minus_probability\": " << options.minus_probability << ",\n";
+    out << "    \"duplicate_fraction\": " << options.duplicate_fraction << ",\n";
+    out << "    \"remove_fraction\": " << options.remove_fraction << ",\n";
+    out << "    \"seed\": " << options.seed << "\n";
+    out << "  },\n";
+    // equal checksums mean two runs computed the same results
+    out << "  \"checksum\": " << setprecision(6) << checksum << setprecision(3) << ",\n";
+    out << "  \"operations\": {\n";
+    for (size_t i = 0; i < operations.size(); ++i) {
+        OperationStats& stats = operations[i];
+        sort(stats.latencies_ns.begin(), stats.latencies_ns.end());
+        int64_t total_ns = 0;
+        for (const int64_t latency : stats.latencies_ns) {
+            total_ns += latency;
+        }
+        out << "    \"" << stats.name << "\": {\n";
+        out << "      \"calls\": " << stats.latencies_ns.size() << ",\n";
+        out << "      \"items\": " << stats.items << ",\n";
+        out << "      \"total_ms\": " << total_ns / 1e6 << ",\n";
+        out << "      \"p50_us\": " << GetPercentileUs(stats.latencies_ns, 50) << ",\n";
+        out << "      \"p99_us\": " << GetPercentileUs(stats.latencies_ns, 99) << ",\n";
+        out << "      \"p999_us\": " << GetPercentileUs(stats.latencies_ns, 99.9) << ",\n";
+        out << "      \"items_per_second\": " << (total_ns > 0 ? stats.items * 1e9 / total_ns : 0.0) << "\n";
+        out << "    }" << (i + 1 < operations.size() ? "," : "") << "\n";
+    }
+    out << "  },\n";
+    // what the server itself recorded while the benchmark ran
+    const MetricsSnapshot metrics = MetricsRegistry::GetInstance().GetSnapshot();
+    out << "  \"counters\": {\n";
+    for (size_t i = 0; i < metrics.counters.size(); ++i) {
+        out << "    \"" << GetMetricName(static_cast<MetricCounter>(i)) << "\": " << metrics.counters[i]
+            << (i + 1 < metrics.counters.size() ? "," : "") << "\n";
+    }
+    out << "  },\n";
+    out << "  \"stages\": {\n";
+    for (size_t i = 0; i < metrics.stages.size(); ++i) {
+        const StageSnapshot& stage = metrics.stages[i];
+        out << "    \"" << GetMetricName(static_cast<MetricStage>(i)) << "\": {"
+            << "\"count\": " << stage.count
+            << ", \"total_ms\": " << stage.total_ns / 1e6
+            << ", \"p50_us_at_most\": " << stage.GetPercentileNs(50) / 1e3
+            << ", \"p99_us_at_most\": " << stage.GetPercentileNs(99) / 1e3
+            << "}" << (i + 1 < metrics.stages.size() ? "," : "") << "\n";
+    }
+    out << "  }\n";
+    out << "}\n";
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = ParseOptions(argc, argv);
+    } catch (const invalid_argument& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    mt19937_64 generator(options.seed);
+    const vector<string> vocabulary = GenerateVocabulary(generator, options);
+    const ZipfDistribution zipf(static_cast<int>(vocabulary.size()), options.zipf);
+
+    vector<string> texts;
+    texts.reserve(options.documents);
+    for (int i = 0; i < options.documents; ++i) {
+        if (i > 0 && uniform_real_distribution<>(0, 1)(generator) < options.duplicate_fraction) {
+            // the same words in another order, for RemoveDuplicates to find
+            vector<string_view> words = SplitIntoWords(texts[uniform_int_distribution(0, i - 1)(generator)]);
+            shuffle(words.begin(), words.end(), generator);
+            string text;
+            for (const string_view word : words) {
+                text.append(text.empty() ? "" : " ").append(word);
+            }
+            texts.push_back(move(text));
+        } else {
+            texts.push_back(GenerateText(generator, vocabulary, zipf, options.document_words, 0.0));
+        }
+    }
+    vector<string> queries;
+    queries.reserve(options.queries);
+    for (int i = 0; i < options.queries; ++i) {
+        queries.push_back(GenerateText(generator, vocabulary, zipf, options.query_words, options.minus_probability));
+    }
+
+    vector<OperationStats> operations;
+    const auto add_operation = [&operations](const string& name) -> OperationStats& {
+        operations.push_back({name, {}, 0});
+        return operations.back();
+    };
+    double checksum = 0.0;
+
+    SearchServer search_server(vocabulary[0]);
+    {
+        OperationStats& stats = add_operation("add_document");
+        for (int i = 0; i < options.documents; ++i) {
+            Measure(stats, 1, [&] {
+                search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            });
+        }
+    }
+    {
+        OperationStats& stats = add_operation("add_documents_par");
+        vector<NewDocument> batch;
+        batch.reserve(texts.size());
+        for (int i = 0; i < options.documents; ++i) {
+            batch.push_back({i, texts[i], DocumentStatus::ACTUAL, {1, 2, 3}});
+        }
+        SearchServer bulk_server(vocabulary[0]);
+        Measure(stats, options.documents, [&] {
+            bulk_server.AddDocuments(execution::par, batch);
+        });
+    }
+    {
+        OperationStats& stats = add_operation("find_top_documents_seq");
+        for (const string& query : queries) {
+            Measure(stats, 1, [&] {
+                for (const Document& document : search_server.FindTopDocuments(execution::seq, query)) {
+                    checksum += document.relevance;
+                }
+            });
+        }
+    }
+    {
+        OperationStats& stats = add_operation("find_top_documents_par");
+        for (const string& query : queries) {
+            Measure(stats, 1, [&] {
+                for (const Document& document : search_server.FindTopDocuments(execution::par, query)) {
+                    checksum += document.relevance;
+                }
+            });
+        }
+    }
+    {
+        OperationStats& stats = add_operation("find_top_documents_max_score");
+        search_server.SetQueryEvaluation(QueryEvaluation::MAX_SCORE);
+        for (const string& query : queries) {
+            Measure(stats, 1, [&] {
+                for (const Document& document : search_server.FindTopDocuments(execution::seq, query)) {
+                    checksum += document.relevance;
+                }
+            });
+        }
+        search_server.SetQueryEvaluation(QueryEvaluation::EXHAUSTIVE);
+    }
+    for (const bool is_parallel : {false, true}) {
+        OperationStats& stats = add_operation(is_parallel ? "match_document_par" : "match_document_seq");
+        for (int i = 0; i < min(options.match_queries, options.queries); ++i) {
+            for (const int document_id : search_server) {
+                Measure(stats, 1, [&] {
+                    const auto [words, status] = is_parallel
+                        ? search_server.MatchDocument(execution::par, queries[i], document_id)
+                        : search_server.MatchDocument(execution::seq, queries[i], document_id);
+                    checksum += words.size();
+                });
+            }
+        }
+    }
+    {
+        OperationStats& stats = add_operation("process_queries");
+        for (int repeat = 0; repeat < options.batch_repeats; ++repeat) {
+            Measure(stats, options.queries, [&] {
+                for (const auto& documents : ProcessQueries(search_server, queries)) {
+                    checksum += documents.size();
+                }
+            });
+        }
+    }
+    {
+        OperationStats& stats = add_operation("remove_duplicates");
+        // RemoveDuplicates reports every removed document on cout, which would break the JSON
+        ostringstream removal_log;
+        streambuf* const cout_buffer = cout.rdbuf(removal_log.rdbuf());
+        const int document_count = search_server.GetDocumentCount();
+        Measure(stats, document_count, [&] {
+            RemoveDuplicates(search_server);
+        });
+        cout.rdbuf(cout_buffer);
+        checksum += document_count - search_server.GetDocumentCount();
+    }
+    for (const bool is_parallel : {false, true}) {
+        OperationStats& stats = add_operation(is_parallel ? "remove_document_par" : "remove_document_seq");
+        vector<int> document_ids(search_server.begin(), search_server.end());
+        shuffle(document_ids.begin(), document_ids.end(), generator);
+        document_ids.resize(static_cast<size_t>(document_ids.size() * options.remove_fraction / 2));
+        for (const int document_id : document_ids) {
+            Measure(stats, 1, [&] {
+                if (is_parallel) {
+                    search_server.RemoveDocument(execution::par, document_id);
+                } else {
+                    search_server.RemoveDocument(execution::seq, document_id);
+                }
+            });
+        }
+    }
+
+    if (options.output.empty()) {
+        PrintJson(cout, options, operations, checksum);
+    } else {
+        ofstream out(options.output);
+        PrintJson(out, options, operations, checksum);
+    }
+}
@@ -0,0 +1,12 @@
+#include "excluded_documents.h"
+
+using namespace std;
+
+vector<int> ExcludedDocuments::CollectOrdinals(const PostingList& postings, int begin_ordinal, int end_ordinal) {
+    vector<int> ordinals;
+    auto cursor = postings.GetCursor();
+    for (cursor.SkipTo(begin_ordinal); !cursor.IsEnd() && cursor->document_ordinal < end_ordinal; cursor.Next()) {
+        ordinals.push_back(cursor->document_ordinal);
+    }
+    return ordinals;
+}
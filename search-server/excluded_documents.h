@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <vector>
+
+#include "posting_list.h"
+
+// Ordinals of the documents that contain a query's minus words, collected before any scoring.
+// Sparse exclusions are kept as a sorted array, dense ones as a bitset over the ordinal range.
+class ExcludedDocuments {
+public:
+    ExcludedDocuments() = default;
+
+    // Collects the ordinals in [begin_ordinal, end_ordinal) found in any of the posting lists
+    template <typename Policy>
+    ExcludedDocuments(Policy& policy, const std::vector<const PostingList*>& postings, int begin_ordinal, int end_ordinal);
+
+    bool IsEmpty() const {
+        return is_empty_;
+    }
+
+    bool Contains(int ordinal) const {
+        if (is_empty_ || ordinal < begin_ordinal_ || ordinal >= end_ordinal_) {
+            return false;
+        }
+        if (!bits_.empty()) {
+            const int offset = ordinal - begin_ordinal_;
+            return (bits_[offset / 64] >> (offset % 64)) & 1;
+        }
+        return std::binary_search(ordinals_.begin(), ordinals_.end(), ordinal);
+    }
+
+private:
+    int begin_ordinal_ = 0;
+    int end_ordinal_ = 0;
+    bool is_empty_ = true;
+    std::vector<uint64_t> bits_;
+    std::vector<int> ordinals_;
+
+    static std::vector<int> CollectOrdinals(const PostingList& postings, int begin_ordinal, int end_ordinal);
+};
+
+template <typename Policy>
+ExcludedDocuments::ExcludedDocuments(Policy& policy, const std::vector<const PostingList*>& postings, int begin_ordinal, int end_ordinal)
+    : begin_ordinal_(begin_ordinal)
+    , end_ordinal_(end_ordinal) {
+    std::vector<std::vector<int>> list_ordinals(postings.size());
+    std::transform(policy,
+        postings.begin(), postings.end(),
+        list_ordinals.begin(),
+        [begin_ordinal, end_ordinal] (const PostingList* list) {
+            return CollectOrdinals(*list, begin_ordinal, end_ordinal);
+        });
+    size_t total_count = 0;
+    for (const auto& ordinals : list_ordinals) {
+        total_count += ordinals.size();
+    }
+    is_empty_ = total_count == 0;
+    // a bitset pays off once there is more than one exclusion per 64 ordinals
+    if (total_count * 64 > static_cast<size_t>(end_ordinal - begin_ordinal)) {
+        bits_.assign((end_ordinal - begin_ordinal + 63) / 64, 0);
+        for (const auto& ordinals : list_ordinals) {
+            for (const int ordinal : ordinals) {
+                const int offset = ordinal - begin_ordinal;
+                bits_[offset / 64] |= uint64_t{1} << (offset % 64);
+            }
+        }
+    } else {
+        ordinals_.reserve(total_count);
+        for (const auto& ordinals : list_ordinals) {
+            ordinals_.insert(ordinals_.end(), ordinals.begin(), ordinals.end());
+        }
+        std::sort(ordinals_.begin(), ordinals_.end());
+        ordinals_.erase(std::unique(ordinals_.begin(), ordinals_.end()), ordinals_.end());
+    }
+}
@@ -0,0 +1,47 @@
+#include "forward_index.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void ForwardIndex::Append(const vector<Entry>& entries) {
+    ranges_.push_back({entries_.size(), entries_.size() + entries.size()});
+    entries_.insert(entries_.end(), entries.begin(), entries.end());
+    live_entry_count_ += entries.size();
+}
+
+void ForwardIndex::Remove(int ordinal) {
+    Range& range = ranges_[ordinal];
+    live_entry_count_ -= range.end - range.begin;
+    range.end = range.begin;
+    if (2 * live_entry_count_ >= entries_.size()) {
+        return;
+    }
+    vector<Entry> entries;
+    entries.reserve(live_entry_count_);
+    for (Range& live_range : ranges_) {
+        const size_t begin = entries.size();
+        entries.insert(entries.end(), entries_.begin() + live_range.begin, entries_.begin() + live_range.end);
+        live_range = {begin, entries.size()};
+    }
+    entries_ = move(entries);
+}
+
+ForwardIndex::Terms ForwardIndex::GetTerms(int ordinal) const {
+    const Range& range = ranges_[ordinal];
+    return Terms(entries_.data() + range.begin, entries_.data() + range.end);
+}
+
+uint32_t ForwardIndex::GetWordCount(int ordinal, TermId term_id) const {
+    const int term_index = FindTerm(ordinal, term_id);
+    return term_index < 0 ? 0 : GetTerms(ordinal).begin()[term_index].word_count;
+}
+
+int ForwardIndex::FindTerm(int ordinal, TermId term_id) const {
+    const Terms terms = GetTerms(ordinal);
+    const Entry* const it = lower_bound(terms.begin(), terms.end(), term_id, [](const Entry& entry, TermId term_id) {
+        return entry.term_id < term_id;
+    });
+    return it != terms.end() && it->term_id == term_id ? static_cast<int>(it - terms.begin()) : -1;
+}
+
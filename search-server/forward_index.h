@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "paginator.h"
+#include "term_dictionary.h"
+
+// Terms of every document by ordinal, as arrays sorted by term id kept in one pool. Arrays of
+// removed documents stay in the pool until most of it is garbage, then the pool is rebuilt.
+class ForwardIndex {
+public:
+    struct Entry {
+        TermId term_id;
+        uint32_t word_count;
+    };
+
+    using Terms = IteratorRange<const Entry*>;
+
+    // The document gets the next ordinal; entries must be sorted by term id
+    void Append(const std::vector<Entry>& entries);
+    void Remove(int ordinal);
+
+    // Empty for removed documents
+    Terms GetTerms(int ordinal) const;
+    // Word count of the term in the document, 0 if the document does not contain it
+    uint32_t GetWordCount(int ordinal, TermId term_id) const;
+    // Index of the term among the document's terms, -1 if the document does not contain it
+    int FindTerm(int ordinal, TermId term_id) const;
+
+private:
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    std::vector<Entry> entries_;
+    std::vector<Range> ranges_; // by ordinal
+    size_t live_entry_count_ = 0;
+};
@@ -0,0 +1,135 @@
+#include "index_file.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char kMagic[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+const uint32_t kByteOrderMark = 0x01020304;
+
+} // namespace
+
+IndexFileWriter::IndexFileWriter(const string& path)
+    : path_(path)
+    , temp_path_(path + ".tmp"s)
+    , out_(temp_path_, ios::binary | ios::trunc) {
+    if (!out_) {
+        throw runtime_error("Cannot create index file "s + temp_path_);
+    }
+    WriteBytes(kMagic, sizeof(kMagic));
+    WriteBytes(&kIndexFileVersion, sizeof(kIndexFileVersion));
+    WriteBytes(&kByteOrderMark, sizeof(kByteOrderMark));
+}
+
+void IndexFileWriter::WriteStrings(const vector<string_view>& strings) {
+    vector<uint64_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    offsets.push_back(0);
+    for (const string_view str : strings) {
+        offsets.push_back(offsets.back() + str.size());
+    }
+    WriteValue<uint64_t>(strings.size());
+    WriteArray(offsets.data(), offsets.size());
+    for (const string_view str : strings) {
+        WriteBytes(str.data(), str.size());
+    }
+    WriteArray<char>(nullptr, 0);
+}
+
+IndexFileWriter::~IndexFileWriter() {
+    if (!is_finished_) {
+        out_.close();
+        remove(temp_path_.c_str());
+    }
+}
+
+// The target is replaced by renaming, a mapping of the old file keeps its contents alive
+void IndexFileWriter::Finish() {
+    out_.close();
+    if (!out_ || rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        throw runtime_error("Cannot write index file "s + path_);
+    }
+    is_finished_ = true;
+}
+
+void IndexFileWriter::WriteBytes(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), size);
+    position_ += size;
+}
+
+IndexFileReader::IndexFileReader(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open index file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("Cannot open index file "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* const address = size_ == 0 ? MAP_FAILED : mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        throw runtime_error("Cannot map index file "s + path);
+    }
+    const size_t size = size_;
+    mapping_ = shared_ptr<const void>(address, [size](const void* mapped) {
+        munmap(const_cast<void*>(mapped), size);
+    });
+    data_ = static_cast<const uint8_t*>(address);
+
+    char magic[sizeof(kMagic)];
+    memcpy(magic, ReadBytes(sizeof(magic)), sizeof(magic));
+    uint32_t version;
+    memcpy(&version, ReadBytes(sizeof(version)), sizeof(version));
+    uint32_t byte_order_mark;
+    memcpy(&byte_order_mark, ReadBytes(sizeof(byte_order_mark)), sizeof(byte_order_mark));
+    if (memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        throw invalid_argument(path + " is not an index file"s);
+    }
+    if (version != kIndexFileVersion || byte_order_mark != kByteOrderMark) {
+        throw invalid_argument("Index file "s + path + " has unsupported format version "s + to_string(version));
+    }
+}
+
+vector<string_view> IndexFileReader::ReadStrings() {
+    const uint64_t count = ReadValue<uint64_t>();
+    if (count >= (size_ - position_) / sizeof(uint64_t)) {
+        throw invalid_argument("Index file is truncated"s);
+    }
+    const uint64_t* const offsets = ReadArray<uint64_t>(count + 1);
+    const char* const chars = ReadArray<char>(offsets[count]);
+    vector<string_view> strings;
+    strings.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        if (offsets[i] > offsets[i + 1]) {
+            throw invalid_argument("Index file is damaged"s);
+        }
+        strings.emplace_back(chars + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return strings;
+}
+
+bool IndexFileReader::IsEnd() const {
+    return position_ == size_;
+}
+
+shared_ptr<const void> IndexFileReader::GetMapping() const {
+    return mapping_;
+}
+
+const uint8_t* IndexFileReader::ReadBytes(size_t size) {
+    if (size > size_ - position_) {
+        throw invalid_argument("Index file is truncated"s);
+    }
+    const uint8_t* const bytes = data_ + position_;
+    position_ += size;
+    return bytes;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Index files start with a magic string and a format version. Data is stored in native byte
+// order, which the header records too. Arrays are padded to kIndexFileAlignment bytes, so a
+// reader can use them in place inside a read-only memory mapping of the file.
+const uint32_t kIndexFileVersion = 1;
+const size_t kIndexFileAlignment = 8;
+
+// Writes next to the target and replaces it only once the file is complete, so a failed save
+// leaves the previous file intact and a mapping of it keeps reading the old contents
+class IndexFileWriter {
+public:
+    explicit IndexFileWriter(const std::string& path);
+    // Removes the partial file if Finish was not reached
+    ~IndexFileWriter();
+
+    template <typename T>
+    void WriteValue(const T& value);
+
+    template <typename T>
+    void WriteArray(const T* values, size_t count);
+
+    void WriteStrings(const std::vector<std::string_view>& strings);
+
+    // Closes the file and moves it over the target, throws if anything failed to be written
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream out_;
+    bool is_finished_ = false;
+    uint64_t position_ = 0;
+
+    void WriteBytes(const void* data, size_t size);
+};
+
+class IndexFileReader {
+public:
+    // Maps the whole file and checks its header
+    explicit IndexFileReader(const std::string& path);
+
+    template <typename T>
+    T ReadValue();
+
+    // The returned array lives as long as the mapping
+    template <typename T>
+    const T* ReadArray(size_t count);
+
+    // Views point into the mapping
+    std::vector<std::string_view> ReadStrings();
+
+    bool IsEnd() const;
+
+    // The mapping is unmapped when the last copy of this pointer goes away
+    std::shared_ptr<const void> GetMapping() const;
+
+private:
+    std::shared_ptr<const void> mapping_;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t position_ = 0;
+
+    const uint8_t* ReadBytes(size_t size);
+};
+
+template <typename T>
+void IndexFileWriter::WriteValue(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) == kIndexFileAlignment);
+    WriteBytes(&value, sizeof(T));
+}
+
+template <typename T>
+void IndexFileWriter::WriteArray(const T* values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= kIndexFileAlignment);
+    WriteBytes(values, count * sizeof(T));
+    static const char padding[kIndexFileAlignment] = {};
+    WriteBytes(padding, (kIndexFileAlignment - position_ % kIndexFileAlignment) % kIndexFileAlignment);
+}
+
+template <typename T>
+T IndexFileReader::ReadValue() {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) == kIndexFileAlignment);
+    T value;
+    std::memcpy(&value, ReadBytes(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template <typename T>
+const T* IndexFileReader::ReadArray(size_t count) {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= kIndexFileAlignment);
+    if (count > (size_ - position_) / sizeof(T)) {
+        throw std::invalid_argument("Index file is truncated");
+    }
+    const uint8_t* const values = ReadBytes(count * sizeof(T));
+    ReadBytes((kIndexFileAlignment - position_ % kIndexFileAlignment) % kIndexFileAlignment);
+    return reinterpret_cast<const T*>(values);
+}
@@ -0,0 +1,72 @@
+#include "index_segment.h"
+
+#include <algorithm>
+
+using namespace std;
+
+IndexSegment::IndexSegment(int begin_ordinal, int end_ordinal, vector<TermId> term_ids, vector<PostingList> postings)
+    : begin_ordinal_(begin_ordinal)
+    , end_ordinal_(end_ordinal)
+    , term_ids_(move(term_ids))
+    , postings_(move(postings)) {
+    for (const PostingList& term_postings : postings_) {
+        posting_count_ += term_postings.size();
+    }
+}
+
+IndexSegment IndexSegment::Merge(const vector<const IndexSegment*>& segments, const vector<bool>& is_removed) {
+    const int begin_ordinal = segments.front()->begin_ordinal_;
+    vector<TermId> term_ids;
+    for (const IndexSegment* segment : segments) {
+        const size_t middle = term_ids.size();
+        term_ids.insert(term_ids.end(), segment->term_ids_.begin(), segment->term_ids_.end());
+        inplace_merge(term_ids.begin(), term_ids.begin() + middle, term_ids.end());
+        term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    }
+
+    // a segment's next term is found by advancing its position, not by searching
+    vector<size_t> positions(segments.size(), 0);
+    vector<TermId> merged_term_ids;
+    vector<PostingList> merged_postings;
+    for (const TermId term_id : term_ids) {
+        PostingList postings;
+        for (size_t index = 0; index < segments.size(); ++index) {
+            const IndexSegment& segment = *segments[index];
+            size_t& position = positions[index];
+            if (position == segment.term_ids_.size() || segment.term_ids_[position] != term_id) {
+                continue;
+            }
+            segment.postings_[position].ForEach([&postings, &is_removed, begin_ordinal](const Posting& posting) {
+                if (!is_removed[posting.document_ordinal - begin_ordinal]) {
+                    postings.Append(posting.document_ordinal, posting.word_count);
+                }
+            });
+            ++position;
+        }
+        if (!postings.empty()) {
+            merged_term_ids.push_back(term_id);
+            merged_postings.push_back(move(postings));
+        }
+    }
+    return IndexSegment(begin_ordinal, segments.back()->end_ordinal_, move(merged_term_ids), move(merged_postings));
+}
+
+int IndexSegment::GetBeginOrdinal() const {
+    return begin_ordinal_;
+}
+
+int IndexSegment::GetEndOrdinal() const {
+    return end_ordinal_;
+}
+
+size_t IndexSegment::GetPostingCount() const {
+    return posting_count_;
+}
+
+const PostingList* IndexSegment::FindPostings(TermId term_id) const {
+    const auto it = lower_bound(term_ids_.begin(), term_ids_.end(), term_id);
+    if (it == term_ids_.end() || *it != term_id) {
+        return nullptr;
+    }
+    return &postings_[it - term_ids_.begin()];
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "posting_list.h"
+#include "term_dictionary.h"
+
+// Posting lists of the documents with ordinals in [begin_ordinal, end_ordinal), by term.
+// A segment never changes once built, so searches and background merges can share it.
+class IndexSegment {
+public:
+    // term_ids must be sorted and unique, postings[i] holds the postings of term_ids[i]
+    IndexSegment(int begin_ordinal, int end_ordinal, std::vector<TermId> term_ids, std::vector<PostingList> postings);
+
+    // Concatenates segments of adjacent ordinal ranges, given in ordinal order. The postings
+    // of documents marked in is_removed, indexed from the first segment's begin ordinal,
+    // are dropped.
+    static IndexSegment Merge(const std::vector<const IndexSegment*>& segments, const std::vector<bool>& is_removed);
+
+    int GetBeginOrdinal() const;
+    int GetEndOrdinal() const;
+    size_t GetPostingCount() const;
+
+    // nullptr when no document of the segment contains the term
+    const PostingList* FindPostings(TermId term_id) const;
+
+private:
+    int begin_ordinal_;
+    int end_ordinal_;
+    std::vector<TermId> term_ids_;
+    std::vector<PostingList> postings_;
+    size_t posting_count_ = 0;
+};
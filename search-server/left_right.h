@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Two replicas of a structure for lock-free reads during changes. Readers pin the published
+// replica, which stays immutable while they use it. A writer changes the other replica,
+// publishes it, waits for a grace period after which no reader can still hold the old one,
+// and then repeats the change on the old replica. Reads never wait; a change is applied
+// twice and waits for the reads in progress.
+template <typename Replica>
+class LeftRight {
+public:
+    LeftRight(Replica first, Replica second);
+
+    template <typename Reader>
+    decltype(auto) Read(Reader reader) const;
+
+    // The writer is called on both replicas and must make the same change to both. If it
+    // throws on the first one, nothing is published; it must not throw on the second one.
+    template <typename Writer>
+    void Write(Writer writer);
+
+private:
+    static const size_t kStripeCount = 32;
+
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> reader_count = 0;
+    };
+
+    // Readers arrive at the indicator of the current epoch. A writer moves the epoch and waits
+    // for both indicators in turn, so readers arriving during the wait cannot stall it.
+    using ReadIndicator = std::array<Stripe, kStripeCount>;
+
+    std::array<Replica, 2> replicas_;
+    std::atomic<int> published_ = 0;
+    std::atomic<int> epoch_ = 0;
+    mutable std::array<ReadIndicator, 2> read_indicators_;
+    std::mutex write_mutex_;
+
+    static size_t GetStripe();
+    void WaitForReaders(int epoch) const;
+};
+
+template <typename Replica>
+LeftRight<Replica>::LeftRight(Replica first, Replica second)
+    : replicas_{std::move(first), std::move(second)} {
+}
+
+template <typename Replica>
+template <typename Reader>
+decltype(auto) LeftRight<Replica>::Read(Reader reader) const {
+    std::atomic<uint64_t>& reader_count = read_indicators_[epoch_.load()][GetStripe()].reader_count;
+    reader_count.fetch_add(1);
+    struct Departure {
+        std::atomic<uint64_t>& reader_count;
+        ~Departure() {
+            reader_count.fetch_sub(1, std::memory_order_release);
+        }
+    } departure{reader_count};
+    return reader(static_cast<const Replica&>(replicas_[published_.load()]));
+}
+
+template <typename Replica>
+template <typename Writer>
+void LeftRight<Replica>::Write(Writer writer) {
+    std::lock_guard guard(write_mutex_);
+    const int published = published_.load();
+    writer(replicas_[1 - published]);
+    published_.store(1 - published);
+
+    const int epoch = epoch_.load();
+    WaitForReaders(1 - epoch);
+    epoch_.store(1 - epoch);
+    WaitForReaders(epoch);
+    writer(replicas_[published]);
+}
+
+template <typename Replica>
+size_t LeftRight<Replica>::GetStripe() {
+    thread_local const size_t stripe = std::hash<std::thread::id>{}(std::this_thread::get_id()) % kStripeCount;
+    return stripe;
+}
+
+template <typename Replica>
+void LeftRight<Replica>::WaitForReaders(int epoch) const {
+    for (const Stripe& stripe : read_indicators_[epoch]) {
+        while (stripe.reader_count.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
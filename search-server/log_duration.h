@@ -2,6 +2,8 @@
 
 #include <chrono>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 using namespace std;
 using namespace chrono;
@@ -12,9 +14,12 @@ using namespace literals;
 #define UNIQUE_VAR_NAME_PROFILE PROFILE_CONCAT(profileGuard, __LINE__)
 #define LOG_DURATION(x) LogDuration UNIQUE_VAR_NAME_PROFILE(x)
 
+// Prints the wall time of a scope to cerr, for examples and manual runs. Production code
+// records stage timings into MetricsRegistry (metrics.h) instead.
+
 class LogDuration {
 public:
-    LogDuration(const std::string& id) : id_(id) {
+    LogDuration(std::string_view id) : id_(id) {
     }
 
     ~LogDuration() {
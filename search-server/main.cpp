@@ -2,7 +2,10 @@
 #include "process_queries.h"
 #include "log_duration.h"
 
+#include <algorithm>
+#include <cmath>
 #include <execution>
+#include <filesystem>
 #include <iostream>
 #include <random>
 #include <string>
@@ -65,6 +68,49 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
     cout << total_relevance << endl;
 }
 
+// MaxScore skips documents that cannot enter the top, so it has to return what exhaustive
+// evaluation does, down to the smallest tops
+void CheckQueryEvaluations(SearchServer& search_server, const vector<string>& queries) {
+    for (const size_t max_count : {size_t{0}, size_t{1}, kMaxDocumentCount}) {
+        for (const string& query : queries) {
+            search_server.SetQueryEvaluation(QueryEvaluation::EXHAUSTIVE);
+            const auto exhaustive = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count);
+            search_server.SetQueryEvaluation(QueryEvaluation::MAX_SCORE);
+            const auto max_score = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count);
+            const bool is_equal = equal(exhaustive.begin(), exhaustive.end(), max_score.begin(), max_score.end(), [](const Document& lhs, const Document& rhs) {
+                return lhs.id == rhs.id && abs(lhs.relevance - rhs.relevance) < kEps;
+            });
+            if (!is_equal) {
+                cout << "Query evaluations differ for "s << query << ", max_count "s << max_count << endl;
+            }
+        }
+    }
+    search_server.SetQueryEvaluation(QueryEvaluation::EXHAUSTIVE);
+}
+
+// A loaded server reads its postings from the mapped file, so saving it over the same file
+// must leave the mapping readable and produce a file that loads to the same results
+void CheckIndexCheckpoint(const SearchServer& search_server, const vector<string>& queries) {
+    const string path = (filesystem::temp_directory_path() / "search_server_check.idx"s).string();
+    search_server.SaveIndex(path);
+    const SearchServer loaded = SearchServer::LoadIndex(path);
+    loaded.SaveIndex(path);
+    const SearchServer reloaded = SearchServer::LoadIndex(path);
+    for (const string& query : queries) {
+        const auto expected = search_server.FindTopDocuments(query);
+        for (const SearchServer* server : {&loaded, &reloaded}) {
+            const auto documents = server->FindTopDocuments(query);
+            const bool is_equal = equal(expected.begin(), expected.end(), documents.begin(), documents.end(), [](const Document& lhs, const Document& rhs) {
+                return lhs.id == rhs.id && abs(lhs.relevance - rhs.relevance) < kEps;
+            });
+            if (!is_equal) {
+                cout << "Checkpointed index differs for "s << query << endl;
+            }
+        }
+    }
+    filesystem::remove(path);
+}
+
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
 int main() {
@@ -74,12 +120,18 @@ int main() {
     const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
 
     SearchServer search_server(dictionary[0]);
+    vector<NewDocument> batch;
+    batch.reserve(documents.size());
     for (size_t i = 0; i < documents.size(); ++i) {
-        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        batch.push_back({static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {1, 2, 3}});
     }
+    search_server.AddDocuments(execution::par, batch);
 
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
 
+    CheckQueryEvaluations(search_server, queries);
+    CheckIndexCheckpoint(search_server, queries);
+
     TEST(seq);
     TEST(par);
 }
\ No newline at end of file
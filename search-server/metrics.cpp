@@ -0,0 +1,193 @@
+#include "metrics.h"
+
+using namespace std;
+
+namespace {
+
+// The shard is written by its owner thread only, so a load and a store make a cheap increment
+void AddRelaxed(atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+thread_local bool is_thread_paused = false;
+
+} // namespace
+
+const char* GetMetricName(MetricCounter counter) {
+    switch (counter) {
+    case MetricCounter::QUERIES_EVALUATED:
+        return "queries_evaluated";
+    case MetricCounter::POSTINGS_SCANNED:
+        return "postings_scanned";
+    case MetricCounter::DOCUMENTS_SCORED:
+        return "documents_scored";
+    case MetricCounter::RESULT_CACHE_HITS:
+        return "result_cache_hits";
+    case MetricCounter::RESULT_CACHE_MISSES:
+        return "result_cache_misses";
+    case MetricCounter::DOCUMENTS_ADDED:
+        return "documents_added";
+    case MetricCounter::DOCUMENTS_REMOVED:
+        return "documents_removed";
+    default:
+        return "unknown";
+    }
+}
+
+const char* GetMetricName(MetricStage stage) {
+    switch (stage) {
+    case MetricStage::QUERY_PARSE:
+        return "query_parse";
+    case MetricStage::POSTING_SCAN:
+        return "posting_scan";
+    case MetricStage::MINUS_WORD_FILTER:
+        return "minus_word_filter";
+    case MetricStage::TOP_K_SELECTION:
+        return "top_k_selection";
+    case MetricStage::QUERY_BATCH:
+        return "query_batch";
+    case MetricStage::ADD_DOCUMENT:
+        return "add_document";
+    case MetricStage::REMOVE_DOCUMENT:
+        return "remove_document";
+    case MetricStage::SEGMENT_MERGE:
+        return "segment_merge";
+    default:
+        return "unknown";
+    }
+}
+
+size_t StageSnapshot::GetBucket(uint64_t duration_ns) {
+    size_t bucket = 0;
+    while (duration_ns != 0 && bucket + 1 < kBucketCount) {
+        duration_ns >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+uint64_t StageSnapshot::GetPercentileNs(double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return bucket == 0 ? 0 : (uint64_t{1} << bucket) - 1;
+        }
+    }
+    return UINT64_MAX;
+}
+
+uint64_t MetricsSnapshot::Get(MetricCounter counter) const {
+    return counters[static_cast<size_t>(counter)];
+}
+
+const StageSnapshot& MetricsSnapshot::Get(MetricStage stage) const {
+    return stages[static_cast<size_t>(stage)];
+}
+
+MetricsRegistry& MetricsRegistry::GetInstance() {
+    // never destroyed: threads give their shards back when they exit, which may happen
+    // after static destructors have run
+    static MetricsRegistry* const registry = new MetricsRegistry;
+    return *registry;
+}
+
+void MetricsRegistry::SetEnabled(bool is_enabled) {
+    is_enabled_.store(is_enabled, memory_order_relaxed);
+}
+
+bool MetricsRegistry::IsEnabled() const {
+    return is_enabled_.load(memory_order_relaxed) && !is_thread_paused;
+}
+
+void MetricsRegistry::Add(MetricCounter counter, uint64_t value) {
+    if (!IsEnabled()) {
+        return;
+    }
+    AddRelaxed(GetThreadShard().counters[static_cast<size_t>(counter)], value);
+}
+
+void MetricsRegistry::RecordDuration(MetricStage stage, uint64_t duration_ns) {
+    if (!IsEnabled()) {
+        return;
+    }
+    Shard& shard = GetThreadShard();
+    const size_t index = static_cast<size_t>(stage);
+    AddRelaxed(shard.stage_counts[index], 1);
+    AddRelaxed(shard.stage_total_ns[index], duration_ns);
+    AddRelaxed(shard.stage_buckets[index][StageSnapshot::GetBucket(duration_ns)], 1);
+}
+
+MetricsSnapshot MetricsRegistry::GetSnapshot() const {
+    MetricsSnapshot snapshot;
+    lock_guard guard(shards_mutex_);
+    for (const auto& shard : shards_) {
+        for (size_t i = 0; i < snapshot.counters.size(); ++i) {
+            snapshot.counters[i] += shard->counters[i].load(memory_order_relaxed);
+        }
+        for (size_t i = 0; i < snapshot.stages.size(); ++i) {
+            StageSnapshot& stage = snapshot.stages[i];
+            stage.count += shard->stage_counts[i].load(memory_order_relaxed);
+            stage.total_ns += shard->stage_total_ns[i].load(memory_order_relaxed);
+            for (size_t bucket = 0; bucket < StageSnapshot::kBucketCount; ++bucket) {
+                stage.buckets[bucket] += shard->stage_buckets[i][bucket].load(memory_order_relaxed);
+            }
+        }
+    }
+    return snapshot;
+}
+
+MetricsRegistry::ShardOwner::ShardOwner(MetricsRegistry& registry)
+    : registry_(registry) {
+    lock_guard guard(registry_.shards_mutex_);
+    if (registry_.free_shards_.empty()) {
+        registry_.shards_.push_back(make_unique<Shard>());
+        shard_ = registry_.shards_.back().get();
+    } else {
+        shard_ = registry_.free_shards_.back();
+        registry_.free_shards_.pop_back();
+    }
+}
+
+MetricsRegistry::ShardOwner::~ShardOwner() {
+    lock_guard guard(registry_.shards_mutex_);
+    registry_.free_shards_.push_back(shard_);
+}
+
+MetricsRegistry::Shard& MetricsRegistry::ShardOwner::GetShard() {
+    return *shard_;
+}
+
+MetricsRegistry::Shard& MetricsRegistry::GetThreadShard() {
+    thread_local ShardOwner owner(*this);
+    return owner.GetShard();
+}
+
+MetricsPause::MetricsPause()
+    : was_paused_(is_thread_paused) {
+    is_thread_paused = true;
+}
+
+MetricsPause::~MetricsPause() {
+    is_thread_paused = was_paused_;
+}
+
+StageTimer::StageTimer(MetricStage stage)
+    : stage_(stage)
+    , is_enabled_(MetricsRegistry::GetInstance().IsEnabled()) {
+    if (is_enabled_) {
+        start_time_ = chrono::steady_clock::now();
+    }
+}
+
+StageTimer::~StageTimer() {
+    if (is_enabled_) {
+        const auto duration = chrono::steady_clock::now() - start_time_;
+        MetricsRegistry::GetInstance().RecordDuration(stage_,
+            static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(duration).count()));
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+enum class MetricCounter {
+    QUERIES_EVALUATED,  // queries run against the index, cache hits are not counted
+    POSTINGS_SCANNED,
+    DOCUMENTS_SCORED,
+    RESULT_CACHE_HITS,
+    RESULT_CACHE_MISSES,
+    DOCUMENTS_ADDED,
+    DOCUMENTS_REMOVED,
+    COUNT,
+};
+
+enum class MetricStage {
+    QUERY_PARSE,
+    POSTING_SCAN,
+    MINUS_WORD_FILTER,
+    TOP_K_SELECTION,
+    QUERY_BATCH,
+    ADD_DOCUMENT,
+    REMOVE_DOCUMENT,
+    SEGMENT_MERGE,
+    COUNT,
+};
+
+const char* GetMetricName(MetricCounter counter);
+const char* GetMetricName(MetricStage stage);
+
+// Durations are kept in a histogram of power-of-two buckets: bucket i counts durations
+// in [2^(i-1), 2^i) nanoseconds, bucket 0 counts zero durations
+struct StageSnapshot {
+    static const size_t kBucketCount = 64;
+
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    std::array<uint64_t, kBucketCount> buckets = {};
+
+    // Upper bound of the bucket holding the percentile, so at most twice the exact value
+    uint64_t GetPercentileNs(double percentile) const;
+
+    static size_t GetBucket(uint64_t duration_ns);
+};
+
+struct MetricsSnapshot {
+    std::array<uint64_t, static_cast<size_t>(MetricCounter::COUNT)> counters = {};
+    std::array<StageSnapshot, static_cast<size_t>(MetricStage::COUNT)> stages = {};
+
+    uint64_t Get(MetricCounter counter) const;
+    const StageSnapshot& Get(MetricStage stage) const;
+};
+
+// Process-wide counters and stage histograms. Every thread records into a shard of its own
+// with plain relaxed stores, so recording never contends. GetSnapshot sums the shards
+// without stopping the writers; a snapshot taken during queries may miss their last updates.
+class MetricsRegistry {
+public:
+    static MetricsRegistry& GetInstance();
+
+    void SetEnabled(bool is_enabled);
+    bool IsEnabled() const;
+
+    void Add(MetricCounter counter, uint64_t value = 1);
+    void RecordDuration(MetricStage stage, uint64_t duration_ns);
+
+    MetricsSnapshot GetSnapshot() const;
+
+private:
+    struct Shard {
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(MetricCounter::COUNT)> counters = {};
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(MetricStage::COUNT)> stage_counts = {};
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(MetricStage::COUNT)> stage_total_ns = {};
+        std::array<std::array<std::atomic<uint64_t>, StageSnapshot::kBucketCount>, static_cast<size_t>(MetricStage::COUNT)> stage_buckets = {};
+    };
+
+    // Gives a shard back to the registry when its thread exits, values stay in it
+    class ShardOwner {
+    public:
+        explicit ShardOwner(MetricsRegistry& registry);
+        ~ShardOwner();
+
+        Shard& GetShard();
+
+    private:
+        MetricsRegistry& registry_;
+        Shard* shard_;
+    };
+
+    std::atomic<bool> is_enabled_ = true;
+    mutable std::mutex shards_mutex_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<Shard*> free_shards_;
+
+    Shard& GetThreadShard();
+};
+
+// Records the time from construction to destruction as a duration of the stage
+class StageTimer {
+public:
+    explicit StageTimer(MetricStage stage);
+    ~StageTimer();
+
+private:
+    MetricStage stage_;
+    bool is_enabled_;
+    std::chrono::steady_clock::time_point start_time_;
+};
+
+// Nothing is recorded on the current thread while a pause exists, for work that repeats
+// an operation already counted
+class MetricsPause {
+public:
+    MetricsPause();
+    ~MetricsPause();
+
+    MetricsPause(const MetricsPause&) = delete;
+    MetricsPause& operator=(const MetricsPause&) = delete;
+
+private:
+    bool was_paused_;
+};
+
+#define METRIC_CONCAT_INTERNAL(X, Y) X##Y
+#define METRIC_CONCAT(X, Y) METRIC_CONCAT_INTERNAL(X, Y)
+#define TIME_STAGE(stage) StageTimer METRIC_CONCAT(stageTimer, __LINE__)(stage)
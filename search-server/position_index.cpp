@@ -0,0 +1,91 @@
+#include "position_index.h"
+
+using namespace std;
+
+namespace {
+
+void WriteVarint(uint32_t value, vector<uint8_t>& bytes) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& data) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+} // namespace
+
+void PositionIndex::Append(const vector<pair<TermId, uint32_t>>& term_positions) {
+    vector<uint8_t> directory;
+    vector<uint8_t> lists;
+    for (size_t begin = 0; begin < term_positions.size();) {
+        const size_t list_begin = lists.size();
+        uint32_t previous_position = 0;
+        size_t end = begin;
+        for (; end < term_positions.size() && term_positions[end].first == term_positions[begin].first; ++end) {
+            WriteVarint(term_positions[end].second - previous_position, lists);
+            previous_position = term_positions[end].second;
+        }
+        WriteVarint(static_cast<uint32_t>(lists.size() - list_begin), directory);
+        begin = end;
+    }
+    ranges_.push_back({bytes_.size(), bytes_.size() + directory.size() + lists.size()});
+    bytes_.insert(bytes_.end(), directory.begin(), directory.end());
+    bytes_.insert(bytes_.end(), lists.begin(), lists.end());
+    live_byte_count_ += directory.size() + lists.size();
+}
+
+void PositionIndex::Remove(int ordinal) {
+    Range& range = ranges_[ordinal];
+    live_byte_count_ -= range.end - range.begin;
+    range.end = range.begin;
+    if (2 * live_byte_count_ >= bytes_.size()) {
+        return;
+    }
+    vector<uint8_t> bytes;
+    bytes.reserve(live_byte_count_);
+    for (Range& live_range : ranges_) {
+        const size_t begin = bytes.size();
+        bytes.insert(bytes.end(), bytes_.begin() + live_range.begin, bytes_.begin() + live_range.end);
+        live_range = {begin, bytes.size()};
+    }
+    bytes_ = move(bytes);
+}
+
+// The directory holds one length per term of the document, so the lists start where the
+// byte lengths of all lists and the directory add up to the whole range
+void PositionIndex::GetPositions(int ordinal, size_t term_index, vector<uint32_t>& positions) const {
+    positions.clear();
+    const Range& range = ranges_[ordinal];
+    const uint8_t* data = bytes_.data() + range.begin;
+    const uint8_t* const end = bytes_.data() + range.end;
+    size_t list_offset = 0;
+    size_t list_size = 0;
+    size_t lists_size = 0;
+    for (size_t index = 0; data + lists_size < end; ++index) {
+        const uint32_t size = ReadVarint(data);
+        if (index < term_index) {
+            list_offset += size;
+        } else if (index == term_index) {
+            list_size = size;
+        }
+        lists_size += size;
+    }
+    const uint8_t* list = data + list_offset;
+    const uint8_t* const list_end = list + list_size;
+    uint32_t position = 0;
+    while (list < list_end) {
+        position += ReadVarint(list);
+        positions.push_back(position);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "term_dictionary.h"
+
+// Positions of the words of every document by ordinal. A document's positions are kept term by
+// term, in term id order like its forward index entries, as varint-coded gaps. The lists are
+// preceded by a directory of their byte lengths, so a list is found without decoding the ones
+// before it. Space of removed documents is reclaimed once most of the pool is garbage.
+class PositionIndex {
+public:
+    // Pairs of a term and a position of the document's words, sorted; the document gets the
+    // next ordinal
+    void Append(const std::vector<std::pair<TermId, uint32_t>>& term_positions);
+    void Remove(int ordinal);
+
+    // Ascending positions of the document's term_index-th term in term id order
+    void GetPositions(int ordinal, size_t term_index, std::vector<uint32_t>& positions) const;
+
+private:
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    std::vector<uint8_t> bytes_;
+    std::vector<Range> ranges_; // by ordinal
+    size_t live_byte_count_ = 0;
+};
@@ -0,0 +1,431 @@
+#include "posting_list.h"
+#include "index_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+uint8_t GetByteWidth(uint32_t max_value) {
+    if (max_value <= UINT8_MAX) {
+        return 1;
+    }
+    if (max_value <= UINT16_MAX) {
+        return 2;
+    }
+    return 4;
+}
+
+void PackValues(const uint32_t* values, size_t size, uint8_t width, uint8_t* out) {
+    for (size_t i = 0; i < size; ++i) {
+        for (uint8_t byte = 0; byte < width; ++byte) {
+            *out++ = static_cast<uint8_t>(values[i] >> (8 * byte));
+        }
+    }
+}
+
+// out[i] = base + i-th little-endian value of `width` bytes
+void UnpackValues(const uint8_t* in, size_t size, uint8_t width, uint32_t base, uint32_t* out) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i base4 = _mm_set1_epi32(static_cast<int>(base));
+    if (width == 1) {
+        for (; i + 16 <= size; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(base4, _mm_unpacklo_epi16(low, zero)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_add_epi32(base4, _mm_unpackhi_epi16(low, zero)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_add_epi32(base4, _mm_unpacklo_epi16(high, zero)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 12), _mm_add_epi32(base4, _mm_unpackhi_epi16(high, zero)));
+        }
+    } else if (width == 2) {
+        for (; i + 8 <= size; i += 8) {
+            const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(base4, _mm_unpacklo_epi16(words, zero)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_add_epi32(base4, _mm_unpackhi_epi16(words, zero)));
+        }
+    } else {
+        for (; i + 4 <= size; i += 4) {
+            const __m128i dwords = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4 * i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(base4, dwords));
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        uint32_t value = 0;
+        for (uint8_t byte = 0; byte < width; ++byte) {
+            value |= static_cast<uint32_t>(in[width * i + byte]) << (8 * byte);
+        }
+        out[i] = base + value;
+    }
+}
+
+} // namespace
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+    : postings_(&postings) {
+    LoadBlock(0);
+}
+
+bool PostingList::Cursor::IsEnd() const {
+    return block_index_ >= postings_->block_count_;
+}
+
+const Posting& PostingList::Cursor::operator*() const {
+    return current_;
+}
+
+const Posting* PostingList::Cursor::operator->() const {
+    return &current_;
+}
+
+void PostingList::Cursor::Next() {
+    if (++position_ < block_.size) {
+        current_ = {block_.ordinals[position_], block_.word_counts[position_]};
+    } else {
+        LoadBlock(block_index_ + 1);
+    }
+}
+
+void PostingList::Cursor::SkipTo(int document_ordinal) {
+    if (IsEnd() || current_.document_ordinal >= document_ordinal) {
+        return;
+    }
+    const BlockHeader* blocks = postings_->block_data_;
+    if (blocks[block_index_].last_ordinal < document_ordinal) {
+        const auto it = lower_bound(blocks + block_index_ + 1, blocks + postings_->block_count_, document_ordinal,
+            [](const BlockHeader& header, int ordinal) {
+                return header.last_ordinal < ordinal;
+            });
+        LoadBlock(it - blocks);
+        if (IsEnd()) {
+            return;
+        }
+    }
+    const int* found = lower_bound(block_.ordinals + position_, block_.ordinals + block_.size, document_ordinal);
+    position_ = found - block_.ordinals;
+    current_ = {block_.ordinals[position_], block_.word_counts[position_]};
+}
+
+void PostingList::Cursor::LoadBlock(size_t block_index) {
+    block_index_ = block_index;
+    position_ = 0;
+    if (IsEnd()) {
+        return;
+    }
+    postings_->DecodeBlock(block_index_, block_);
+    current_ = {block_.ordinals[0], block_.word_counts[0]};
+}
+
+PostingList::PostingList(const PostingList& other)
+    : block_data_(other.block_data_)
+    , block_count_(other.block_count_)
+    , ordinal_data_(other.ordinal_data_)
+    , ordinal_byte_count_(other.ordinal_byte_count_)
+    , count_data_(other.count_data_)
+    , count_byte_count_(other.count_byte_count_)
+    , is_mapped_(other.is_mapped_)
+    , blocks_(other.blocks_)
+    , ordinal_bytes_(other.ordinal_bytes_)
+    , count_bytes_(other.count_bytes_)
+    , size_(other.size_)
+    , encoded_bytes_(other.encoded_bytes_) {
+    if (!is_mapped_) {
+        SyncViews();
+    }
+}
+
+PostingList& PostingList::operator=(const PostingList& other) {
+    if (this != &other) {
+        PostingList copy(other);
+        *this = move(copy);
+    }
+    return *this;
+}
+
+void PostingList::Append(int document_ordinal, uint32_t word_count) {
+    MakeOwned();
+    DecodedBlock block;
+    if (!blocks_.empty() && blocks_.back().size < kBlockSize) {
+        const BlockHeader& last = blocks_.back();
+        const uint32_t delta = static_cast<uint32_t>(document_ordinal - last.first_ordinal);
+        if (IsLastBlockAtEnd() && GetByteWidth(delta) <= last.ordinal_width && GetByteWidth(word_count) <= last.count_width) {
+            // the new posting fits the block's widths, so it is packed in place
+            uint8_t ordinal_buffer[4];
+            uint8_t count_buffer[4];
+            PackValues(&delta, 1, last.ordinal_width, ordinal_buffer);
+            PackValues(&word_count, 1, last.count_width, count_buffer);
+            ordinal_bytes_.insert(ordinal_bytes_.end(), ordinal_buffer, ordinal_buffer + last.ordinal_width);
+            count_bytes_.insert(count_bytes_.end(), count_buffer, count_buffer + last.count_width);
+            ++blocks_.back().size;
+            blocks_.back().last_ordinal = document_ordinal;
+            encoded_bytes_ += last.ordinal_width + last.count_width;
+            ++size_;
+            SyncViews();
+            return;
+        }
+        DecodeBlock(blocks_.size() - 1, block);
+        encoded_bytes_ -= last.size * (last.ordinal_width + last.count_width);
+        ordinal_bytes_.resize(last.ordinal_offset);
+        count_bytes_.resize(last.count_offset);
+        blocks_.pop_back();
+    }
+    block.ordinals[block.size] = document_ordinal;
+    block.word_counts[block.size] = word_count;
+    ++block.size;
+    EncodeLastBlock(block);
+    ++size_;
+    SyncViews();
+}
+
+void PostingList::Erase(int document_ordinal) {
+    const size_t block_index = FindBlock(document_ordinal);
+    if (block_index == block_count_) {
+        return;
+    }
+    DecodedBlock block;
+    DecodeBlock(block_index, block);
+    int* const found = lower_bound(block.ordinals, block.ordinals + block.size, document_ordinal);
+    if (found == block.ordinals + block.size || *found != document_ordinal) {
+        return;
+    }
+    MakeOwned();
+    const size_t position = found - block.ordinals;
+    copy(block.ordinals + position + 1, block.ordinals + block.size, block.ordinals + position);
+    copy(block.word_counts + position + 1, block.word_counts + block.size, block.word_counts + position);
+    --block.size;
+    --size_;
+
+    BlockHeader& header = blocks_[block_index];
+    encoded_bytes_ -= header.ordinal_width + header.count_width;
+    if (block.size == 0) {
+        blocks_.erase(blocks_.begin() + block_index);
+    } else {
+        // deltas from the new first ordinal can only shrink, so the block is rewritten in place
+        uint32_t deltas[kBlockSize];
+        for (size_t i = 0; i < block.size; ++i) {
+            deltas[i] = static_cast<uint32_t>(block.ordinals[i] - block.ordinals[0]);
+        }
+        PackValues(deltas, block.size, header.ordinal_width, &ordinal_bytes_[header.ordinal_offset]);
+        PackValues(block.word_counts, block.size, header.count_width, &count_bytes_[header.count_offset]);
+        header.first_ordinal = block.ordinals[0];
+        header.last_ordinal = block.ordinals[block.size - 1];
+        header.size = static_cast<uint16_t>(block.size);
+    }
+    if (block_index + 1 >= blocks_.size()) {
+        TruncateAfterLastBlock();
+    }
+    if (2 * encoded_bytes_ < ordinal_bytes_.size() + count_bytes_.size()) {
+        Compact();
+    }
+    SyncViews();
+}
+
+bool PostingList::Contains(int document_ordinal) const {
+    const size_t block_index = FindBlock(document_ordinal);
+    if (block_index == block_count_ || block_data_[block_index].first_ordinal > document_ordinal) {
+        return false;
+    }
+    DecodedBlock block;
+    DecodeBlock(block_index, block);
+    return binary_search(block.ordinals, block.ordinals + block.size, document_ordinal);
+}
+
+size_t PostingList::GetBlockCount() const {
+    return block_count_;
+}
+
+int PostingList::GetBlockFirstOrdinal(size_t block_index) const {
+    return block_data_[block_index].first_ordinal;
+}
+
+int PostingList::GetBlockLastOrdinal(size_t block_index) const {
+    return block_data_[block_index].last_ordinal;
+}
+
+void PostingList::DecodeBlock(size_t block_index, DecodedBlock& block) const {
+    const BlockHeader& header = block_data_[block_index];
+    block.size = header.size;
+    UnpackValues(ordinal_data_ + header.ordinal_offset, header.size, header.ordinal_width,
+        static_cast<uint32_t>(header.first_ordinal), reinterpret_cast<uint32_t*>(block.ordinals));
+    UnpackValues(count_data_ + header.count_offset, header.size, header.count_width, 0, block.word_counts);
+}
+
+PostingList::Cursor PostingList::GetCursor() const {
+    return Cursor(*this);
+}
+
+size_t PostingList::size() const {
+    return size_;
+}
+
+bool PostingList::empty() const {
+    return size_ == 0;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return sizeof(PostingList) + blocks_.capacity() * sizeof(BlockHeader)
+        + ordinal_bytes_.capacity() + count_bytes_.capacity();
+}
+
+void PostingList::Save(IndexFileWriter& writer) const {
+    writer.WriteValue<uint64_t>(size_);
+    writer.WriteValue<uint64_t>(encoded_bytes_);
+    writer.WriteValue<uint64_t>(block_count_);
+    writer.WriteValue<uint64_t>(ordinal_byte_count_);
+    writer.WriteValue<uint64_t>(count_byte_count_);
+    writer.WriteArray(block_data_, block_count_);
+    writer.WriteArray(ordinal_data_, ordinal_byte_count_);
+    writer.WriteArray(count_data_, count_byte_count_);
+}
+
+PostingList PostingList::Load(IndexFileReader& reader, int ordinal_count) {
+    static_assert(sizeof(BlockHeader) == 20 && alignof(BlockHeader) <= kIndexFileAlignment);
+    PostingList postings;
+    postings.is_mapped_ = true;
+    postings.size_ = reader.ReadValue<uint64_t>();
+    postings.encoded_bytes_ = reader.ReadValue<uint64_t>();
+    postings.block_count_ = reader.ReadValue<uint64_t>();
+    postings.ordinal_byte_count_ = reader.ReadValue<uint64_t>();
+    postings.count_byte_count_ = reader.ReadValue<uint64_t>();
+    postings.block_data_ = reader.ReadArray<BlockHeader>(postings.block_count_);
+    postings.ordinal_data_ = reader.ReadArray<uint8_t>(postings.ordinal_byte_count_);
+    postings.count_data_ = reader.ReadArray<uint8_t>(postings.count_byte_count_);
+
+    // decoding trusts the headers, so a damaged file must not get past here
+    size_t posting_count = 0;
+    int previous_ordinal = -1;
+    for (size_t block_index = 0; block_index < postings.block_count_; ++block_index) {
+        const BlockHeader& header = postings.block_data_[block_index];
+        const auto is_valid_width = [](uint8_t width) {
+            return width == 1 || width == 2 || width == 4;
+        };
+        if (header.size == 0 || header.size > kBlockSize
+            || !is_valid_width(header.ordinal_width) || !is_valid_width(header.count_width)
+            || header.ordinal_offset + uint64_t{header.size} * header.ordinal_width > postings.ordinal_byte_count_
+            || header.count_offset + uint64_t{header.size} * header.count_width > postings.count_byte_count_
+            || header.first_ordinal <= previous_ordinal || header.last_ordinal < header.first_ordinal
+            || header.last_ordinal >= ordinal_count) {
+            throw invalid_argument("Index file contains a damaged posting list"s);
+        }
+        previous_ordinal = header.last_ordinal;
+        posting_count += header.size;
+    }
+    if (posting_count != postings.size_) {
+        throw invalid_argument("Index file contains a damaged posting list"s);
+    }
+    return postings;
+}
+
+// Copies the data of a mapped list, so that it can be changed
+void PostingList::MakeOwned() {
+    if (!is_mapped_) {
+        return;
+    }
+    blocks_.assign(block_data_, block_data_ + block_count_);
+    ordinal_bytes_.assign(ordinal_data_, ordinal_data_ + ordinal_byte_count_);
+    count_bytes_.assign(count_data_, count_data_ + count_byte_count_);
+    is_mapped_ = false;
+    SyncViews();
+}
+
+void PostingList::SyncViews() {
+    block_data_ = blocks_.data();
+    block_count_ = blocks_.size();
+    ordinal_data_ = ordinal_bytes_.data();
+    ordinal_byte_count_ = ordinal_bytes_.size();
+    count_data_ = count_bytes_.data();
+    count_byte_count_ = count_bytes_.size();
+}
+
+// Returns the first block whose last ordinal is not less than document_ordinal
+size_t PostingList::FindBlock(int document_ordinal) const {
+    const auto it = lower_bound(block_data_, block_data_ + block_count_, document_ordinal,
+        [](const BlockHeader& header, int ordinal) {
+            return header.last_ordinal < ordinal;
+        });
+    return it - block_data_;
+}
+
+void PostingList::EncodeLastBlock(const DecodedBlock& block) {
+    uint32_t deltas[kBlockSize];
+    for (size_t i = 0; i < block.size; ++i) {
+        deltas[i] = static_cast<uint32_t>(block.ordinals[i] - block.ordinals[0]);
+    }
+    BlockHeader header;
+    header.first_ordinal = block.ordinals[0];
+    header.last_ordinal = block.ordinals[block.size - 1];
+    header.ordinal_offset = static_cast<uint32_t>(ordinal_bytes_.size());
+    header.count_offset = static_cast<uint32_t>(count_bytes_.size());
+    header.size = static_cast<uint16_t>(block.size);
+    header.ordinal_width = GetByteWidth(deltas[block.size - 1]);
+    header.count_width = GetByteWidth(*max_element(block.word_counts, block.word_counts + block.size));
+
+    ordinal_bytes_.resize(ordinal_bytes_.size() + block.size * header.ordinal_width);
+    count_bytes_.resize(count_bytes_.size() + block.size * header.count_width);
+    PackValues(deltas, block.size, header.ordinal_width, &ordinal_bytes_[header.ordinal_offset]);
+    PackValues(block.word_counts, block.size, header.count_width, &count_bytes_[header.count_offset]);
+    blocks_.push_back(header);
+    encoded_bytes_ += block.size * (header.ordinal_width + header.count_width);
+}
+
+bool PostingList::IsLastBlockAtEnd() const {
+    const BlockHeader& last = blocks_.back();
+    return last.ordinal_offset + last.size * last.ordinal_width == ordinal_bytes_.size()
+        && last.count_offset + last.size * last.count_width == count_bytes_.size();
+}
+
+// Gives back the bytes a shrunk or dropped last block no longer needs
+void PostingList::TruncateAfterLastBlock() {
+    if (blocks_.empty()) {
+        ordinal_bytes_.clear();
+        count_bytes_.clear();
+        return;
+    }
+    const BlockHeader& last = blocks_.back();
+    ordinal_bytes_.resize(last.ordinal_offset + last.size * last.ordinal_width);
+    count_bytes_.resize(last.count_offset + last.size * last.count_width);
+}
+
+// Re-encodes all postings into full blocks laid out back to back, dropping the slack
+void PostingList::Compact() {
+    vector<BlockHeader> blocks;
+    blocks.swap(blocks_);
+    const vector<uint8_t> ordinal_bytes = move(ordinal_bytes_);
+    const vector<uint8_t> count_bytes = move(count_bytes_);
+    ordinal_bytes_.clear();
+    count_bytes_.clear();
+    encoded_bytes_ = 0;
+
+    DecodedBlock full_block;
+    for (const BlockHeader& header : blocks) {
+        uint32_t ordinals[kBlockSize];
+        uint32_t word_counts[kBlockSize];
+        UnpackValues(&ordinal_bytes[header.ordinal_offset], header.size, header.ordinal_width,
+            static_cast<uint32_t>(header.first_ordinal), ordinals);
+        UnpackValues(&count_bytes[header.count_offset], header.size, header.count_width, 0, word_counts);
+        for (size_t i = 0; i < header.size; ++i) {
+            full_block.ordinals[full_block.size] = static_cast<int>(ordinals[i]);
+            full_block.word_counts[full_block.size] = word_counts[i];
+            if (++full_block.size == kBlockSize) {
+                EncodeLastBlock(full_block);
+                full_block.size = 0;
+            }
+        }
+    }
+    if (full_block.size > 0) {
+        EncodeLastBlock(full_block);
+    }
+    blocks_.shrink_to_fit();
+    ordinal_bytes_.shrink_to_fit();
+    count_bytes_.shrink_to_fit();
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class IndexFileReader;
+class IndexFileWriter;
+
+// Documents are numbered by ordinals in order of addition, so appending keeps a list sorted
+struct Posting {
+    int document_ordinal;
+    uint32_t word_count;    // occurrences of the term in the document
+};
+
+// Ordinal-sorted posting list of a single term, compressed in blocks of kBlockSize postings.
+// Inside a block ordinals are stored as deltas from the block's first ordinal and word counts
+// as plain integers, each packed into 1, 2 or 4 bytes depending on the block's value range.
+// Every block has a header with its ordinal range, so lookups and cursors can skip whole
+// blocks without decoding them.
+class PostingList {
+public:
+    static const size_t kBlockSize = 128;
+
+    PostingList() = default;
+    PostingList(const PostingList& other);
+    PostingList(PostingList&& other) noexcept = default;
+    PostingList& operator=(const PostingList& other);
+    PostingList& operator=(PostingList&& other) noexcept = default;
+
+    struct DecodedBlock {
+        int ordinals[kBlockSize];
+        uint32_t word_counts[kBlockSize];
+        size_t size = 0;
+    };
+
+    // Forward iterator over postings that decodes one block at a time
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList& postings);
+
+        bool IsEnd() const;
+        const Posting& operator*() const;
+        const Posting* operator->() const;
+        void Next();
+
+        // Moves to the first posting with an ordinal not less than document_ordinal
+        void SkipTo(int document_ordinal);
+
+    private:
+        const PostingList* postings_;
+        size_t block_index_ = 0;
+        size_t position_ = 0;
+        DecodedBlock block_;
+        Posting current_;
+
+        void LoadBlock(size_t block_index);
+    };
+
+    // document_ordinal must be greater than any ordinal already in the list
+    void Append(int document_ordinal, uint32_t word_count);
+
+    void Erase(int document_ordinal);
+
+    bool Contains(int document_ordinal) const;
+
+    size_t GetBlockCount() const;
+    int GetBlockFirstOrdinal(size_t block_index) const;
+    int GetBlockLastOrdinal(size_t block_index) const;
+    void DecodeBlock(size_t block_index, DecodedBlock& block) const;
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+    Cursor GetCursor() const;
+
+    size_t size() const;
+    bool empty() const;
+    size_t GetMemoryUsage() const;
+
+    void Save(IndexFileWriter& writer) const;
+    // The loaded list reads its data from the reader's mapping until it is first changed
+    static PostingList Load(IndexFileReader& reader, int ordinal_count);
+
+private:
+    struct BlockHeader {
+        int first_ordinal;
+        int last_ordinal;
+        uint32_t ordinal_offset;
+        uint32_t count_offset;
+        uint16_t size;
+        uint8_t ordinal_width;
+        uint8_t count_width;
+    };
+
+    // Encoded data is read through these views. They point either into the vectors below or
+    // into a mapped index file; a mapped list copies the data into the vectors on first change.
+    const BlockHeader* block_data_ = nullptr;
+    size_t block_count_ = 0;
+    const uint8_t* ordinal_data_ = nullptr;
+    size_t ordinal_byte_count_ = 0;
+    const uint8_t* count_data_ = nullptr;
+    size_t count_byte_count_ = 0;
+    bool is_mapped_ = false;
+
+    std::vector<BlockHeader> blocks_;
+    std::vector<uint8_t> ordinal_bytes_;
+    std::vector<uint8_t> count_bytes_;
+    size_t size_ = 0;
+    // bytes taken by live postings, the rest is slack left inside blocks that lost postings
+    size_t encoded_bytes_ = 0;
+
+    void MakeOwned();
+    void SyncViews();
+    size_t FindBlock(int document_ordinal) const;
+    bool IsLastBlockAtEnd() const;
+    void TruncateAfterLastBlock();
+    void EncodeLastBlock(const DecodedBlock& block);
+    void Compact();
+};
+
+template <typename Function>
+void PostingList::ForEach(Function function) const {
+    DecodedBlock block;
+    for (size_t block_index = 0; block_index < block_count_; ++block_index) {
+        DecodeBlock(block_index, block);
+        for (size_t i = 0; i < block.size; ++i) {
+            function(Posting{block.ordinals[i], block.word_counts[i]});
+        }
+    }
+}
@@ -2,29 +2,188 @@
 
 #include <algorithm>
 #include <execution>
+#include <unordered_map>
 
 using namespace std;
 
+QueryBatchResults::Iterator::Iterator(const QueryBatchResults* results, size_t query_index)
+    : results_(results)
+    , query_index_(query_index) {
+    SkipEmptyQueries();
+}
+
+QueryBatchResults::Iterator::reference QueryBatchResults::Iterator::operator*() const {
+    return results_->GetQueryResult(query_index_)[document_index_];
+}
+
+QueryBatchResults::Iterator::pointer QueryBatchResults::Iterator::operator->() const {
+    return &**this;
+}
+
+QueryBatchResults::Iterator& QueryBatchResults::Iterator::operator++() {
+    if (++document_index_ == results_->GetQueryResult(query_index_).size()) {
+        ++query_index_;
+        document_index_ = 0;
+        SkipEmptyQueries();
+    }
+    return *this;
+}
+
+QueryBatchResults::Iterator QueryBatchResults::Iterator::operator++(int) {
+    Iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+bool QueryBatchResults::Iterator::operator==(const Iterator& other) const {
+    return query_index_ == other.query_index_ && document_index_ == other.document_index_;
+}
+
+bool QueryBatchResults::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+void QueryBatchResults::Iterator::SkipEmptyQueries() {
+    while (query_index_ < results_->GetQueryCount() && results_->GetQueryResult(query_index_).empty()) {
+        ++query_index_;
+    }
+}
+
+QueryBatchResults::QueryBatchResults(vector<vector<Document>> unique_results, vector<size_t> query_to_result)
+    : unique_results_(move(unique_results))
+    , query_to_result_(move(query_to_result)) {
+}
+
+size_t QueryBatchResults::GetQueryCount() const {
+    return query_to_result_.size();
+}
+
+const vector<Document>& QueryBatchResults::GetQueryResult(size_t query_index) const {
+    return unique_results_[query_to_result_[query_index]];
+}
+
+size_t QueryBatchResults::size() const {
+    size_t document_count = 0;
+    for (const size_t result_index : query_to_result_) {
+        document_count += unique_results_[result_index].size();
+    }
+    return document_count;
+}
+
+QueryBatchResults::Iterator QueryBatchResults::begin() const {
+    return Iterator(this, 0);
+}
+
+QueryBatchResults::Iterator QueryBatchResults::end() const {
+    return Iterator(this, GetQueryCount());
+}
+
+BatchQueryEngine::BatchQueryEngine(const SearchServer& search_server, ThreadPool& thread_pool)
+    : search_server_(search_server)
+    , thread_pool_(thread_pool) {
+}
+
+QueryBatchResults BatchQueryEngine::Process(const vector<string>& queries) const {
+    TIME_STAGE(MetricStage::QUERY_BATCH);
+    if (search_server_.replicas_) {
+        return search_server_.replicas_->Read([this, &queries](const SearchServer& replica) {
+            return Process(replica, queries);
+        });
+    }
+    return Process(search_server_, queries);
+}
+
+QueryBatchResults BatchQueryEngine::Process(const SearchServer& server, const vector<string>& queries) const {
+    QueryResultCache* const result_cache = search_server_.result_cache_.get();
+    vector<SearchServer::Query> parsed_queries(queries.size());
+    thread_pool_.ParallelFor(queries.size(), [&server, &queries, &parsed_queries](size_t index) {
+        parsed_queries[index] = server.ParseQuery(queries[index]);
+    });
+
+    // queries with the same plus words (counting repeats), the same minus words and the same
+    // phrases and NEAR operators are identical
+    unordered_map<string, size_t> key_to_result;
+    vector<size_t> query_to_result(queries.size());
+    vector<const SearchServer::Query*> unique_queries;
+    vector<string> cache_keys;
+    for (size_t index = 0; index < queries.size(); ++index) {
+        SearchServer::Query& query = parsed_queries[index];
+        const auto [it, inserted] = key_to_result.emplace(SearchServer::NormalizeQuery(query), unique_queries.size());
+        if (inserted) {
+            unique_queries.push_back(&query);
+            if (result_cache) {
+                cache_keys.push_back(SearchServer::MakeResultCacheKey(it->first, DocumentStatus::ACTUAL, kMaxDocumentCount));
+            }
+        }
+        query_to_result[index] = it->second;
+    }
+
+    vector<vector<Document>> unique_results(unique_queries.size());
+    vector<size_t> missed_queries;
+    for (size_t index = 0; index < unique_queries.size(); ++index) {
+        if (!result_cache) {
+            missed_queries.push_back(index);
+        } else if (auto documents = result_cache->Find(cache_keys[index], server.generation_)) {
+            unique_results[index] = move(*documents);
+        } else {
+            missed_queries.push_back(index);
+        }
+    }
+
+    // each distinct word of the batch is looked up once
+    unordered_map<string_view, TermId> word_to_term;
+    const auto find_term_ids = [&server, &word_to_term](const vector<string_view>& words) {
+        vector<TermId> term_ids;
+        for (const string_view word : words) {
+            auto it = word_to_term.find(word);
+            if (it == word_to_term.end()) {
+                it = word_to_term.emplace(word, server.terms_.Find(word)).first;
+            }
+            if (it->second != kNoTerm) {
+                term_ids.push_back(it->second);
+            }
+        }
+        return term_ids;
+    };
+    vector<vector<TermId>> plus_term_ids(missed_queries.size());
+    vector<vector<TermId>> minus_term_ids(missed_queries.size());
+    vector<SearchServer::ProximityQuery> proximities(missed_queries.size());
+    for (size_t index = 0; index < missed_queries.size(); ++index) {
+        plus_term_ids[index] = find_term_ids(unique_queries[missed_queries[index]]->plus_words);
+        minus_term_ids[index] = find_term_ids(unique_queries[missed_queries[index]]->minus_words);
+        proximities[index] = server.ResolveProximity(*unique_queries[missed_queries[index]]);
+    }
+
+    thread_pool_.ParallelFor(missed_queries.size(), [&server, &plus_term_ids, &minus_term_ids, &proximities, &missed_queries, &unique_results](size_t index) {
+        const auto query = server.ResolveQuery(move(plus_term_ids[index]), minus_term_ids[index], move(proximities[index]));
+        unique_results[missed_queries[index]] = server.FindTopDocumentsResolved(execution::seq, query,
+            SearchServer::StatusPredicate{DocumentStatus::ACTUAL}, kMaxDocumentCount);
+    });
+    if (result_cache) {
+        for (const size_t index : missed_queries) {
+            result_cache->Insert(move(cache_keys[index]), server.generation_, unique_results[index]);
+        }
+    }
+    return QueryBatchResults(move(unique_results), move(query_to_result));
+}
+
 vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries)
 {
      //LOG_DURATION("ProcessQueries"s);
+    const QueryBatchResults batch_results = BatchQueryEngine(search_server).Process(queries);
     vector<vector<Document>> result(queries.size());
-    transform(execution::par, queries.begin(), queries.end(), result.begin(),
-        [&search_server](const std::string& query) { 
-            return search_server.FindTopDocuments(query); 
-        });
+    for (size_t index = 0; index < queries.size(); ++index) {
+        result[index] = batch_results.GetQueryResult(index);
+    }
     return result;
 }
 
-std::vector<Document> ProcessQueriesJoined(
-    const SearchServer& search_server, const std::vector<std::string>& queries) {
-    std::vector<Document> result;
-    
-    for (auto& documents : ProcessQueries(search_server, queries)) {
-        for (auto& document : documents) {
-            result.push_back(std::move(document));
-        }
-    }
+QueryBatchResults ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries) {
+    return BatchQueryEngine(search_server).Process(queries);
+}
 
-    return result;
+void ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries, vector<Document>& output) {
+    const QueryBatchResults batch_results = BatchQueryEngine(search_server).Process(queries);
+    output.reserve(output.size() + batch_results.size());
+    output.insert(output.end(), batch_results.begin(), batch_results.end());
 }
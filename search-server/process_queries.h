@@ -2,12 +2,78 @@
 
 #include "document.h"
 #include "search_server.h"
+#include "thread_pool.h"
+#include <iterator>
 #include <string>
 #include <vector>
 
+// Results of a query batch. Queries that normalize to the same words share one result,
+// and iterating the object walks the documents of all queries in query order without
+// joining them into a new vector.
+class QueryBatchResults {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Document;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Document*;
+        using reference = const Document&;
+
+        Iterator(const QueryBatchResults* results, size_t query_index);
+
+        reference operator*() const;
+        pointer operator->() const;
+        Iterator& operator++();
+        Iterator operator++(int);
+        bool operator==(const Iterator& other) const;
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        const QueryBatchResults* results_;
+        size_t query_index_;
+        size_t document_index_ = 0;
+
+        void SkipEmptyQueries();
+    };
+
+    QueryBatchResults(std::vector<std::vector<Document>> unique_results, std::vector<size_t> query_to_result);
+
+    size_t GetQueryCount() const;
+    const std::vector<Document>& GetQueryResult(size_t query_index) const;
+
+    // Documents of all queries together
+    size_t size() const;
+    Iterator begin() const;
+    Iterator end() const;
+
+private:
+    std::vector<std::vector<Document>> unique_results_;
+    std::vector<size_t> query_to_result_;
+};
+
+// Evaluates query batches on a persistent thread pool: identical queries are evaluated
+// once, and every distinct word of the batch is looked up in the index only once
+class BatchQueryEngine {
+public:
+    explicit BatchQueryEngine(const SearchServer& search_server, ThreadPool& thread_pool = ThreadPool::GetShared());
+
+    // Same results as SearchServer::FindTopDocuments(query) for every query
+    QueryBatchResults Process(const std::vector<std::string>& queries) const;
+
+private:
+    const SearchServer& search_server_;
+    ThreadPool& thread_pool_;
+
+    // The whole batch reads one index, the published replica when concurrent reads are enabled
+    QueryBatchResults Process(const SearchServer& server, const std::vector<std::string>& queries) const;
+};
 
 std::vector<std::vector<Document>> 
 ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries);
 
-std::vector<Document> 
-ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
\ No newline at end of file
+QueryBatchResults 
+ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries);
+
+// Appends the joined results to a caller-provided buffer
+void ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries, std::vector<Document>& output);
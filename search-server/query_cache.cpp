@@ -0,0 +1,67 @@
+#include "query_cache.h"
+#include "metrics.h"
+
+#include <functional>
+
+using namespace std;
+
+QueryResultCache::QueryResultCache(size_t capacity)
+    : shard_capacity_((capacity + kShardCount - 1) / kShardCount) {
+}
+
+optional<vector<Document>> QueryResultCache::Find(const string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    {
+        lock_guard guard(shard.mutex);
+        const auto it = shard.key_to_entry.find(key);
+        if (it != shard.key_to_entry.end()) {
+            const auto entry = it->second;
+            if (entry->generation == generation) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+                ++hits_;
+                MetricsRegistry::GetInstance().Add(MetricCounter::RESULT_CACHE_HITS);
+                return entry->documents;
+            }
+            shard.key_to_entry.erase(it);
+            shard.entries.erase(entry);
+        }
+    }
+    ++misses_;
+    MetricsRegistry::GetInstance().Add(MetricCounter::RESULT_CACHE_MISSES);
+    return nullopt;
+}
+
+void QueryResultCache::Insert(string key, uint64_t generation, vector<Document> documents) {
+    if (shard_capacity_ == 0) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    if (const auto it = shard.key_to_entry.find(key); it != shard.key_to_entry.end()) {
+        // a concurrent miss on the same query may have inserted it already
+        const auto entry = it->second;
+        shard.key_to_entry.erase(it);
+        shard.entries.erase(entry);
+    }
+    shard.entries.push_front({move(key), generation, move(documents)});
+    shard.key_to_entry.emplace(shard.entries.front().key, shard.entries.begin());
+    if (shard.entries.size() > shard_capacity_) {
+        shard.key_to_entry.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+}
+
+QueryResultCache::Stats QueryResultCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_.load();
+    stats.misses = misses_.load();
+    for (const Shard& shard : shards_) {
+        lock_guard guard(shard.mutex);
+        stats.size += shard.entries.size();
+    }
+    return stats;
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const string& key) {
+    return shards_[hash<string>{}(key) % kShardCount];
+}
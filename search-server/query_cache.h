@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+// LRU cache of search results. Every entry remembers the index generation it was computed
+// for; an entry from an older generation is a miss and gets dropped. The cache is split into
+// independently locked shards so concurrent queries rarely wait for each other.
+class QueryResultCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t size = 0;
+    };
+
+    // capacity is split evenly between the shards and rounded up
+    explicit QueryResultCache(size_t capacity);
+
+    std::optional<std::vector<Document>> Find(const std::string& key, uint64_t generation);
+    void Insert(std::string key, uint64_t generation, std::vector<Document> documents);
+
+    Stats GetStats() const;
+
+private:
+    static const size_t kShardCount = 16;
+
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        // most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> key_to_entry;
+    };
+
+    size_t shard_capacity_;
+    Shard shards_[kShardCount];
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+
+    Shard& GetShard(const std::string& key);
+};
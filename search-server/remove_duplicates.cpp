@@ -1,35 +1,195 @@
 #include "remove_duplicates.h"
 
+#include <algorithm>
+#include <array>
+#include <execution>
 #include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
 
+using namespace std;
 
-void RemoveDuplicates(SearchServer& search_server)
-{ 
-    //нужно найти набор слов для каждого документа
-    // Затем сравнить set и map и удалить по найденному document_id
-    map<set<string>, int> word_to_document_freqs;   
-    set<int> documents_to_delete;
+namespace {
 
-    for (auto document_id : search_server) {
-        set<string> words;
-        
-        for (auto& [document, freqs] : search_server.GetWordFrequencies(document_id)) {
-            words.insert(document);
-            
+const size_t kLshBandCount = 32;
+const size_t kLshRowCount = 4;
+const size_t kMinHashCount = kLshBandCount * kLshRowCount;
+
+using MinHashSignature = array<uint64_t, kMinHashCount>;
+
+uint64_t MixHash(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+// Word sets as ascending word ids, read from the forward index
+vector<vector<TermId>> GetWordSets(const SearchServer& search_server, const vector<int>& document_ids) {
+    vector<vector<TermId>> word_sets(document_ids.size());
+    transform(execution::par, document_ids.begin(), document_ids.end(), word_sets.begin(),
+        [&search_server](int document_id) {
+            return search_server.GetWordIds(document_id);
+        });
+    return word_sets;
+}
+
+uint64_t ComputeFingerprint(const vector<TermId>& words) {
+    uint64_t fingerprint = MixHash(words.size());
+    for (const TermId word : words) {
+        fingerprint = MixHash(fingerprint ^ MixHash(word));
+    }
+    return fingerprint;
+}
+
+MinHashSignature ComputeMinHashSignature(const vector<TermId>& words) {
+    MinHashSignature signature;
+    signature.fill(UINT64_MAX);
+    for (const TermId word : words) {
+        const uint64_t word_hash = MixHash(word);
+        for (size_t index = 0; index < kMinHashCount; ++index) {
+            signature[index] = min(signature[index], MixHash(word_hash + index * 0x9e3779b97f4a7c15ULL));
+        }
+    }
+    return signature;
+}
+
+// Both word sets are sorted
+double ComputeJaccardSimilarity(const vector<TermId>& lhs, const vector<TermId>& rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+    size_t common_count = 0;
+    auto lhs_it = lhs.begin();
+    auto rhs_it = rhs.begin();
+    while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+        if (*lhs_it < *rhs_it) {
+            ++lhs_it;
+        } else if (*rhs_it < *lhs_it) {
+            ++rhs_it;
+        } else {
+            ++common_count;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+    return static_cast<double>(common_count) / (lhs.size() + rhs.size() - common_count);
+}
+
+void RemoveFoundDuplicates(SearchServer& search_server, const vector<int>& duplicate_ids) {
+    for (const int document_id : duplicate_ids) {
+        cout << "Found duplicate document id " << document_id << endl;
+    }
+    search_server.RemoveDocuments(execution::par, duplicate_ids);
+}
+
+} // namespace
+
+// Word sets are compared only when their fingerprints are equal
+vector<int> FindDuplicates(const SearchServer& search_server) {
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+    const vector<vector<TermId>> word_sets = GetWordSets(search_server, document_ids);
+
+    // pairs of a fingerprint and a document index, the index follows the id order
+    vector<size_t> indexes(document_ids.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    vector<pair<uint64_t, size_t>> fingerprints(document_ids.size());
+    transform(execution::par, indexes.begin(), indexes.end(), fingerprints.begin(),
+        [&word_sets](size_t index) {
+            return pair{ComputeFingerprint(word_sets[index]), index};
+        });
+    sort(execution::par, fingerprints.begin(), fingerprints.end());
+
+    vector<int> duplicate_ids;
+    vector<size_t> kept_indexes;
+    for (size_t begin = 0; begin < fingerprints.size();) {
+        size_t end = begin + 1;
+        while (end < fingerprints.size() && fingerprints[end].first == fingerprints[begin].first) {
+            ++end;
+        }
+        // a group holds more than one word set only on a hash collision
+        kept_indexes.clear();
+        for (size_t position = begin; position < end; ++position) {
+            const size_t index = fingerprints[position].second;
+            const bool is_duplicate = any_of(kept_indexes.begin(), kept_indexes.end(),
+                [&word_sets, index](size_t kept_index) {
+                    return word_sets[kept_index] == word_sets[index];
+                });
+            if (is_duplicate) {
+                duplicate_ids.push_back(document_ids[index]);
+            } else {
+                kept_indexes.push_back(index);
+            }
+        }
+        begin = end;
+    }
+    sort(duplicate_ids.begin(), duplicate_ids.end());
+    return duplicate_ids;
+}
+
+// Documents are decided in id order: a document is a duplicate if it is similar enough to a
+// kept document it shares an LSH bucket with
+vector<int> FindNearDuplicates(const SearchServer& search_server, double min_similarity) {
+    if (!(min_similarity > 0.0 && min_similarity <= 1.0)) {
+        throw invalid_argument("Similarity threshold must be in (0, 1]");
+    }
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+    const vector<vector<TermId>> word_sets = GetWordSets(search_server, document_ids);
+
+    vector<array<uint64_t, kLshBandCount>> band_keys(document_ids.size());
+    transform(execution::par, word_sets.begin(), word_sets.end(), band_keys.begin(),
+        [](const vector<TermId>& words) {
+            const MinHashSignature signature = ComputeMinHashSignature(words);
+            array<uint64_t, kLshBandCount> keys;
+            for (size_t band = 0; band < kLshBandCount; ++band) {
+                uint64_t key = MixHash(band);
+                for (size_t row = 0; row < kLshRowCount; ++row) {
+                    key = MixHash(key ^ signature[band * kLshRowCount + row]);
+                }
+                keys[band] = key;
+            }
+            return keys;
+        });
+
+    vector<int> duplicate_ids;
+    unordered_map<uint64_t, vector<size_t>> bucket_to_kept;
+    vector<size_t> checked_indexes;
+    for (size_t index = 0; index < document_ids.size(); ++index) {
+        bool is_duplicate = false;
+        checked_indexes.clear();
+        for (size_t band = 0; band < kLshBandCount && !is_duplicate; ++band) {
+            const auto bucket = bucket_to_kept.find(band_keys[index][band]);
+            if (bucket == bucket_to_kept.end()) {
+                continue;
+            }
+            for (const size_t kept_index : bucket->second) {
+                if (find(checked_indexes.begin(), checked_indexes.end(), kept_index) != checked_indexes.end()) {
+                    continue;
+                }
+                checked_indexes.push_back(kept_index);
+                if (ComputeJaccardSimilarity(word_sets[kept_index], word_sets[index]) >= min_similarity) {
+                    is_duplicate = true;
+                    break;
+                }
+            }
         }
-        if (word_to_document_freqs.find(words) == word_to_document_freqs.end()) {
-            word_to_document_freqs[words] = document_id;
+        if (is_duplicate) {
+            duplicate_ids.push_back(document_ids[index]);
+        } else {
+            for (const uint64_t key : band_keys[index]) {
+                bucket_to_kept[key].push_back(index);
+            }
         }
-        else if (document_id > word_to_document_freqs[words])
-        {
-            //cout<<document_id <<endl;
-            //cout<<word_to_document_freqs[words]<<endl;
-            word_to_document_freqs[words] = document_id;
-            documents_to_delete.insert(document_id);
-       }   
-    }
-    for (const int& document : documents_to_delete) {
-        cout << "Found duplicate document id " << document << endl;
-        search_server.RemoveDocument(document);
-    }
-}
\ No newline at end of file
+    }
+    return duplicate_ids;
+}
+
+void RemoveDuplicates(SearchServer& search_server) {
+    RemoveFoundDuplicates(search_server, FindDuplicates(search_server));
+}
+
+void RemoveDuplicates(SearchServer& search_server, double min_similarity) {
+    RemoveFoundDuplicates(search_server, FindNearDuplicates(search_server, min_similarity));
+}
@@ -1,5 +1,18 @@
 #pragma once
 
+#include <vector>
+
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Ids of documents with the same set of words as a document with a smaller id, ascending
+std::vector<int> FindDuplicates(const SearchServer& search_server);
+
+// Ids of documents whose word sets have Jaccard similarity of at least min_similarity with a
+// kept document with a smaller id, ascending. Candidates come from MinHash signatures split
+// into LSH bands and are verified exactly; a similar pair that shares no band is missed, which
+// for similarity 0.5 happens with probability about 0.13 and for 0.8 below 1e-6.
+std::vector<int> FindNearDuplicates(const SearchServer& search_server, double min_similarity);
+
+void RemoveDuplicates(SearchServer& search_server);
+// Removes near-duplicates found by FindNearDuplicates
+void RemoveDuplicates(SearchServer& search_server, double min_similarity);
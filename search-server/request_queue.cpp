@@ -1,42 +1,113 @@
 #include "request_queue.h"
+#include <thread>
 
 
-RequestQueue:: RequestQueue(const SearchServer& search_server)
+RequestQueue:: RequestQueue(const SearchServer& search_server, Clock::duration bucket_duration, size_t bucket_count)
     : search_server_(search_server)
-        , no_results_requests_(0)
-        , current_time_(0) {
+        , start_time_(Clock::now())
+        , bucket_duration_(bucket_duration)
+        , bucket_count_(bucket_count)
+        , buckets_(make_unique<Bucket[]>(bucket_count)) {
+    if (bucket_duration <= Clock::duration::zero() || bucket_count == 0) {
+        throw invalid_argument("Request window must have buckets of positive duration"s);
+    }
 }
-  
+
 vector<Document>  RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
+    const Clock::time_point start = Clock::now();
     const auto result = search_server_.FindTopDocuments(raw_query, status);
-    AddRequest(result.size());
+    AddRequest(result.size(), Clock::now() - start);
     return result;
 }
- 
+
 vector<Document>  RequestQueue::AddFindRequest(const string& raw_query) {
+    const Clock::time_point start = Clock::now();
     const auto result = search_server_.FindTopDocuments(raw_query);
-    AddRequest(result.size());
+    AddRequest(result.size(), Clock::now() - start);
     return result;
 }
- 
+
 int  RequestQueue::GetNoResultRequests() const {
-    return no_results_requests_;
+    return static_cast<int>(GetStats().no_result_count);
 }
- 
 
-void  RequestQueue::AddRequest(int results_num) {
-    // новый запрос - новая секунда
-    ++current_time_;
-    // удаляем все результаты поиска, которые устарели
-    while (!requests_.empty() && min_in_day_ <= current_time_ - requests_.front().timestamp) {
-        if (0 == requests_.front().results) {
-            --no_results_requests_;
+RequestQueue::Stats RequestQueue::GetStats(Clock::duration window) const {
+    const Clock::time_point now = Clock::now();
+    const int64_t last_index = GetBucketIndex(now);
+    const int64_t window_buckets = min<int64_t>(bucket_count_, max<int64_t>(1, (window + bucket_duration_ - Clock::duration(1)) / bucket_duration_));
+    const int64_t first_index = max<int64_t>(0, last_index - window_buckets + 1);
+
+    Stats stats;
+    for (int64_t index = first_index; index <= last_index; ++index) {
+        const Bucket& bucket = buckets_[index % bucket_count_];
+        if (bucket.index.load(memory_order_acquire) != index) {
+            continue;
         }
-        requests_.pop_front();
+        // counters are read while requests may still be added, the totals are approximate
+        stats.request_count += bucket.request_count.load(memory_order_relaxed);
+        stats.no_result_count += bucket.no_result_count.load(memory_order_relaxed);
+        stats.latency.total_ns += bucket.total_latency_ns.load(memory_order_relaxed);
+        for (size_t i = 0; i < StageSnapshot::kBucketCount; ++i) {
+            const uint64_t count = bucket.latency_buckets[i].load(memory_order_relaxed);
+            stats.latency.buckets[i] += count;
+            stats.latency.count += count;
+        }
+    }
+    if (stats.request_count > 0) {
+        stats.no_result_rate = static_cast<double>(stats.no_result_count) / stats.request_count;
+    }
+    const double elapsed_seconds = chrono::duration<double>(now - (start_time_ + first_index * bucket_duration_)).count();
+    if (elapsed_seconds > 0.0) {
+        stats.queries_per_second = stats.request_count / elapsed_seconds;
+    }
+    return stats;
+}
+
+RequestQueue::Stats RequestQueue::GetStats() const {
+    return GetStats(bucket_duration_ * static_cast<int64_t>(bucket_count_));
+}
+
+void  RequestQueue::AddRequest(size_t result_count, Clock::duration latency) {
+    Bucket* const bucket = AcquireBucket(GetBucketIndex(Clock::now()));
+    if (bucket == nullptr) {
+        return;
     }
-    // сохраняем новый результат поиска
-    requests_.push_back({current_time_, results_num});
-    if (0 == results_num) {
-        ++no_results_requests_;
+    const uint64_t latency_ns = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(latency).count());
+    bucket->request_count.fetch_add(1, memory_order_relaxed);
+    if (result_count == 0) {
+        bucket->no_result_count.fetch_add(1, memory_order_relaxed);
+    }
+    bucket->total_latency_ns.fetch_add(latency_ns, memory_order_relaxed);
+    bucket->latency_buckets[StageSnapshot::GetBucket(latency_ns)].fetch_add(1, memory_order_relaxed);
+}
+
+// The thread that moves a bucket to a new index clears it; others wait the few stores it takes.
+// A thread delayed by a whole turn of the wheel between taking a bucket and counting into it
+// would count into the next turn.
+RequestQueue::Bucket* RequestQueue::AcquireBucket(int64_t index) {
+    Bucket& bucket = buckets_[index % bucket_count_];
+    int64_t held_index = bucket.index.load(memory_order_acquire);
+    while (held_index != index) {
+        if (held_index > index) {
+            return nullptr;
+        }
+        if (held_index == kClearing) {
+            this_thread::yield();
+            held_index = bucket.index.load(memory_order_acquire);
+        } else if (bucket.index.compare_exchange_weak(held_index, kClearing, memory_order_acquire)) {
+            bucket.request_count.store(0, memory_order_relaxed);
+            bucket.no_result_count.store(0, memory_order_relaxed);
+            bucket.total_latency_ns.store(0, memory_order_relaxed);
+            for (auto& count : bucket.latency_buckets) {
+                count.store(0, memory_order_relaxed);
+            }
+            bucket.index.store(index, memory_order_release);
+            return &bucket;
+        }
     }
+    return &bucket;
+}
+
+int64_t RequestQueue::GetBucketIndex(Clock::time_point time) const {
+    return (time - start_time_) / bucket_duration_;
 }
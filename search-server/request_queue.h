@@ -1,42 +1,77 @@
 #pragma once
-#include <queue>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include "metrics.h"
 #include "search_server.h"
 
-
+// Statistics of the searches made through the queue over a sliding window of wall-clock time.
+// Requests are counted in a time wheel: a ring of buckets, each covering bucket_duration, that
+// together cover the longest window. Any number of threads may add requests at once; they
+// update atomic counters of the current bucket and take no lock. The first request of a new
+// bucket clears the counters left from the previous turn of the wheel.
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
-    
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t request_count = 0;
+        uint64_t no_result_count = 0;
+        double no_result_rate = 0.0;
+        double queries_per_second = 0.0;
+        StageSnapshot latency; // of the searches themselves
+    };
+
+    // By default the window is a day, counted by minutes
+    explicit RequestQueue(const SearchServer& search_server,
+        Clock::duration bucket_duration = std::chrono::minutes(1), size_t bucket_count = 1440);
+
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
-  
+
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
- 
+
     std::vector<Document> AddFindRequest(const std::string& raw_query);
- 
+
+    // Over the whole wheel
     int GetNoResultRequests() const;
-        
+
+    // The window is rounded up to whole buckets and limited to the wheel. The current bucket
+    // counts as far as it has elapsed, and QPS counts no time before the queue was created.
+    Stats GetStats(Clock::duration window) const;
+    Stats GetStats() const;
+
 private:
-    struct QueryResult {
-        uint64_t timestamp;
-        int results;
+    struct alignas(64) Bucket {
+        // bucket number counted from the start time, kNoIndex before the first request
+        std::atomic<int64_t> index = kNoIndex;
+        std::atomic<uint64_t> request_count = 0;
+        std::atomic<uint64_t> no_result_count = 0;
+        std::atomic<uint64_t> total_latency_ns = 0;
+        std::array<std::atomic<uint64_t>, StageSnapshot::kBucketCount> latency_buckets = {};
     };
-    deque<QueryResult> requests_;
-    const SearchServer& search_server_;
-    int no_results_requests_;
-    uint64_t current_time_;
-    const static int min_in_day_ = 1440;
- 
-    void AddRequest(int results_num);   
-    
-};
 
+    static const int64_t kNoIndex = -1;
+    static const int64_t kClearing = -2;
 
+    const SearchServer& search_server_;
+    const Clock::time_point start_time_;
+    const Clock::duration bucket_duration_;
+    const size_t bucket_count_;
+    std::unique_ptr<Bucket[]> buckets_;
+
+    void AddRequest(size_t result_count, Clock::duration latency);
+    // nullptr if the wheel has already moved past the bucket
+    Bucket* AcquireBucket(int64_t index);
+    int64_t GetBucketIndex(Clock::time_point time) const;
+};
 
-// сделаем "обертки" для всех методов поиска, чтобы сохранять результаты для нашей статистики
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue:: AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+    const Clock::time_point start = Clock::now();
     const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
-    AddRequest(result.size());
+    AddRequest(result.size(), Clock::now() - start);
     return result;
 }
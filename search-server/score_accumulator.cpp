@@ -0,0 +1,87 @@
+#include "score_accumulator.h"
+
+#include <mutex>
+
+using namespace std;
+
+namespace {
+
+mutex accumulator_pool_mutex;
+vector<unique_ptr<ConcurrentScoreAccumulator>> accumulator_pool;
+
+} // namespace
+
+ScoreAccumulator& ScoreAccumulator::GetThreadInstance() {
+    thread_local ScoreAccumulator accumulator;
+    return accumulator;
+}
+
+void ScoreAccumulator::Reset(size_t ordinal_count) {
+    for (const int ordinal : touched_) {
+        scores_[ordinal] = 0.0;
+        is_touched_[ordinal] = 0;
+    }
+    touched_.clear();
+    if (scores_.size() < ordinal_count) {
+        scores_.resize(ordinal_count, 0.0);
+        is_touched_.resize(ordinal_count, 0);
+    }
+}
+
+void ScoreAccumulator::Add(int ordinal, double score) {
+    if (!is_touched_[ordinal]) {
+        is_touched_[ordinal] = 1;
+        touched_.push_back(ordinal);
+    }
+    scores_[ordinal] += score;
+}
+
+void ConcurrentScoreAccumulator::PoolReturner::operator()(ConcurrentScoreAccumulator* accumulator) const {
+    lock_guard guard(accumulator_pool_mutex);
+    accumulator_pool.emplace_back(accumulator);
+}
+
+ConcurrentScoreAccumulator::Handle ConcurrentScoreAccumulator::Acquire() {
+    {
+        lock_guard guard(accumulator_pool_mutex);
+        if (!accumulator_pool.empty()) {
+            Handle accumulator(accumulator_pool.back().release());
+            accumulator_pool.pop_back();
+            return accumulator;
+        }
+    }
+    return Handle(new ConcurrentScoreAccumulator);
+}
+
+void ConcurrentScoreAccumulator::Reset(size_t ordinal_count) {
+    const size_t touched_count = touched_count_.load();
+    for (size_t i = 0; i < touched_count; ++i) {
+        scores_[touched_[i]].store(0.0, memory_order_relaxed);
+        is_touched_[touched_[i]].store(0, memory_order_relaxed);
+    }
+    touched_count_ = 0;
+    if (capacity_ < ordinal_count) {
+        capacity_ = ordinal_count;
+        scores_ = make_unique<atomic<double>[]>(capacity_);
+        is_touched_ = make_unique<atomic<uint8_t>[]>(capacity_);
+        touched_ = make_unique<int[]>(capacity_);
+        for (size_t i = 0; i < capacity_; ++i) {
+            scores_[i].store(0.0, memory_order_relaxed);
+            is_touched_[i].store(0, memory_order_relaxed);
+        }
+    }
+}
+
+void ConcurrentScoreAccumulator::Add(int ordinal, double score) {
+    // the thread that flips the flag is the one to list the slot
+    if (is_touched_[ordinal].load(memory_order_relaxed) == 0 && is_touched_[ordinal].exchange(1, memory_order_relaxed) == 0) {
+        touched_[touched_count_.fetch_add(1, memory_order_relaxed)] = ordinal;
+    }
+    double current = scores_[ordinal].load(memory_order_relaxed);
+    while (!scores_[ordinal].compare_exchange_weak(current, current + score, memory_order_relaxed)) {
+    }
+}
+
+size_t ConcurrentScoreAccumulator::GetTouchedCount() const {
+    return touched_count_.load();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Relevance of documents matched by one query, in a dense array indexed by document ordinal.
+// Touched ordinals are listed separately, so gathering results and resetting the storage for
+// the next query cost O(matched documents) rather than O(all documents).
+class ScoreAccumulator {
+public:
+    // Storage reused by all queries evaluated on the calling thread
+    static ScoreAccumulator& GetThreadInstance();
+
+    // Prepares the accumulator for a query over ordinals [0, ordinal_count)
+    void Reset(size_t ordinal_count);
+
+    void Add(int ordinal, double score);
+
+    // function(ordinal, score) is called for every scored document
+    template <typename Function>
+    void ForEachScored(Function function) const;
+
+private:
+    std::vector<double> scores_;
+    std::vector<uint8_t> is_touched_;
+    std::vector<int> touched_;
+};
+
+// The same accumulator for scoring from many threads at once: per-document slots are atomic
+// and the touched list is filled through an atomic cursor, so no locks are taken
+class ConcurrentScoreAccumulator {
+public:
+    struct PoolReturner {
+        void operator()(ConcurrentScoreAccumulator* accumulator) const;
+    };
+    using Handle = std::unique_ptr<ConcurrentScoreAccumulator, PoolReturner>;
+
+    // Takes an accumulator from a shared pool; it is returned when the handle is destroyed.
+    // Unlike the sequential one it is not thread-local: a thread waiting inside a parallel
+    // query may run another parallel query as stolen work.
+    static Handle Acquire();
+
+    void Reset(size_t ordinal_count);
+
+    void Add(int ordinal, double score);
+
+    size_t GetTouchedCount() const;
+    // Calls function(ordinal, score) for the scored documents among touched [begin, end)
+    template <typename Function>
+    void ForEachScored(size_t begin, size_t end, Function function) const;
+
+private:
+    size_t capacity_ = 0;
+    std::unique_ptr<std::atomic<double>[]> scores_;
+    std::unique_ptr<std::atomic<uint8_t>[]> is_touched_;
+    std::unique_ptr<int[]> touched_;
+    std::atomic<size_t> touched_count_ = 0;
+};
+
+template <typename Function>
+void ScoreAccumulator::ForEachScored(Function function) const {
+    for (const int ordinal : touched_) {
+        function(ordinal, scores_[ordinal]);
+    }
+}
+
+template <typename Function>
+void ConcurrentScoreAccumulator::ForEachScored(size_t begin, size_t end, Function function) const {
+    for (size_t i = begin; i < end; ++i) {
+        const int ordinal = touched_[i];
+        function(ordinal, scores_[ordinal].load(std::memory_order_relaxed));
+    }
+}
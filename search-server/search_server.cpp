@@ -1,6 +1,12 @@
 #include "search_server.h"
+#include <charconv>
+#include <cinttypes>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <execution>
+#include <unordered_set>
  
 
 SearchServer:: SearchServer(const string& stop_words_text): SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor
@@ -11,31 +17,281 @@ SearchServer:: SearchServer(string_view stop_words_text): SearchServer(SplitInto
 {
 }
 
+void SearchServer::EnableConcurrentReads() {
+    if (replicas_) {
+        return;
+    }
+    if (!ordinals_.empty()) {
+        throw invalid_argument("Concurrent reads must be enabled before documents are added"s);
+    }
+    const auto make_replica = [this] {
+        SearchServer replica(vector<string_view>(stop_words_.begin(), stop_words_.end()));
+        replica.query_evaluation_ = query_evaluation_;
+        replica.write_buffer_capacity_ = write_buffer_capacity_;
+        if (positions_) {
+            replica.positions_ = make_unique<PositionIndex>();
+        }
+        return replica;
+    };
+    replicas_ = make_unique<LeftRight<SearchServer>>(make_replica(), make_replica());
+}
+
+// The change is repeated on the second replica, where it is not counted again
+template <typename Change>
+void SearchServer::ChangeReplicas(Change change) {
+    bool is_repeated = false;
+    replicas_->Write([&change, &is_repeated](SearchServer& replica) {
+        if (is_repeated) {
+            MetricsPause pause;
+            change(replica);
+        } else {
+            change(replica);
+            is_repeated = true;
+        }
+    });
+}
+
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) { // S8 9.3 
+    if (replicas_) {
+        ChangeReplicas([&](SearchServer& replica) {
+            replica.AddDocument(document_id, document, status, ratings);
+        });
+        return;
+    }
+    InstallMerge(false);
+    TIME_STAGE(MetricStage::ADD_DOCUMENT);
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         throw invalid_argument("document contains wrong id"s);
     }
-    const auto [it, inserted] = documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, string(document)}); 
-    const auto words = SplitIntoWordsNoStop(it->second.data);
+    // words are only read until they are interned, so the caller's text can be split
+    thread_local vector<string_view> words;
+    thread_local vector<uint32_t> positions;
+    SplitIntoWordsNoStop(document, words, positions_ ? &positions : nullptr);
+    const int ordinal = static_cast<int>(ordinals_.size());
+    const int rating = ComputeAverageRating(ratings);
+    documents_.emplace(document_id, DocumentData{rating, status, StoreDocumentText(document), ordinal});
     const double inv_word_count = 1.0 / words.size();
-    map<string_view, double> word_to_freqs;
+    ordinals_.push_back({document_id, status, inv_word_count, rating});
+    map<string_view, uint32_t> word_to_counts;
     for (const string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        word_to_freqs[word] += inv_word_count;
+        ++word_to_counts[word];
+    }
+    vector<ForwardIndex::Entry> document_terms;
+    document_terms.reserve(word_to_counts.size());
+    for (const auto [word, word_count] : word_to_counts) {
+        const TermId term_id = terms_.Intern(word);
+        if (term_id == static_cast<TermId>(term_entries_.size())) {
+            term_entries_.emplace_back();
+        }
+        const double term_freq = word_count * inv_word_count;
+        TermEntry& term_entry = term_entries_[term_id];
+        term_entry.buffered_postings.Append(ordinal, word_count);
+        term_entry.max_term_freq = max(term_entry.max_term_freq, term_freq);
+        ++term_entry.document_count;
+        UpdateDocumentFreq(term_entry);
+        document_terms.push_back({term_id, word_count});
+    }
+    sort(document_terms.begin(), document_terms.end(), [](const ForwardIndex::Entry& lhs, const ForwardIndex::Entry& rhs) {
+        return lhs.term_id < rhs.term_id;
+    });
+    forward_index_.Append(document_terms);
+    if (positions_) {
+        positions_->Append(FindTermPositions(words, positions));
+    }
+    buffered_posting_count_ += word_to_counts.size();
+    if (buffered_posting_count_ >= write_buffer_capacity_) {
+        SealWriteBuffer();
     }
     document_ids_.insert(document_id);
+    ++generation_;
+    MetricsRegistry::GetInstance().Add(MetricCounter::DOCUMENTS_ADDED);
+}
+
+// Documents are tokenized in parallel chunks. The terms are interned in batch order, exactly as
+// AddDocument would, then every chunk gathers the partial postings of its ordinal range, and
+// the partial lists are appended to the index by disjoint ranges of terms.
+template <typename Policy>
+void SearchServer::AddDocumentBatch(Policy& policy, const vector<NewDocument>& documents) {
+    if (replicas_) {
+        ChangeReplicas([&](SearchServer& replica) {
+            replica.AddDocumentBatch(policy, documents);
+        });
+        return;
+    }
+    InstallMerge(false);
+    TIME_STAGE(MetricStage::ADD_DOCUMENT);
+    // ids are checked before tokenizing, as AddDocument does
+    vector<bool> is_wrong_id(documents.size());
+    unordered_set<int> batch_ids;
+    for (size_t index = 0; index < documents.size(); ++index) {
+        const int document_id = documents[index].id;
+        is_wrong_id[index] = document_id < 0 || documents_.count(document_id) > 0 || !batch_ids.insert(document_id).second;
+    }
+
+    struct DocumentWords {
+        vector<pair<string_view, uint32_t>> word_counts; // ordered by word
+        vector<TermId> term_ids;
+        // in text order, kept only while positions are on
+        vector<string_view> words;
+        vector<uint32_t> positions;
+        double inv_word_count = 0.0;
+        exception_ptr error;
+    };
+    vector<DocumentWords> document_words(documents.size());
+    const size_t chunk_count = is_same_v<decay_t<Policy>, execution::parallel_policy> ? max(1u, thread::hardware_concurrency()) : 1;
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+    vector<size_t> chunk_indexes(chunk_count);
+    iota(chunk_indexes.begin(), chunk_indexes.end(), 0);
+    for_each(policy,
+        chunk_indexes.begin(), chunk_indexes.end(),
+        [this, &documents, &is_wrong_id, &document_words, chunk_size](size_t chunk_index) {
+            const size_t begin = min(documents.size(), chunk_index * chunk_size);
+            const size_t end = min(documents.size(), begin + chunk_size);
+            vector<string_view> split_words;
+            for (size_t index = begin; index < end; ++index) {
+                if (is_wrong_id[index]) {
+                    continue;
+                }
+                DocumentWords& words = document_words[index];
+                try {
+                    SplitIntoWordsNoStop(documents[index].text, split_words, positions_ ? &words.positions : nullptr);
+                } catch (...) {
+                    words.error = current_exception();
+                    continue;
+                }
+                if (positions_) {
+                    words.words = split_words;
+                }
+                words.inv_word_count = 1.0 / split_words.size();
+                sort(split_words.begin(), split_words.end());
+                for (const string_view word : split_words) {
+                    if (!words.word_counts.empty() && words.word_counts.back().first == word) {
+                        ++words.word_counts.back().second;
+                    } else {
+                        words.word_counts.push_back({word, 1});
+                    }
+                }
+            }
+        });
+    for (size_t index = 0; index < documents.size(); ++index) {
+        if (is_wrong_id[index]) {
+            throw invalid_argument("document contains wrong id"s);
+        }
+        if (document_words[index].error) {
+            rethrow_exception(document_words[index].error);
+        }
+    }
+
+    const int first_ordinal = static_cast<int>(ordinals_.size());
+    for (size_t index = 0; index < documents.size(); ++index) {
+        const NewDocument& document = documents[index];
+        DocumentWords& words = document_words[index];
+        const int rating = ComputeAverageRating(document.ratings);
+        documents_.emplace(document.id, DocumentData{rating, document.status, StoreDocumentText(document.text), first_ordinal + static_cast<int>(index)});
+        ordinals_.push_back({document.id, document.status, words.inv_word_count, rating});
+        document_ids_.insert(document.id);
+        words.term_ids.reserve(words.word_counts.size());
+        for (const auto& [word, word_count] : words.word_counts) {
+            words.term_ids.push_back(terms_.Intern(word));
+        }
+    }
+    term_entries_.resize(terms_.size());
+
+    // partial postings of each chunk, ordered by term and then by ordinal
+    vector<vector<pair<TermId, Posting>>> chunk_postings(chunk_count);
+    vector<vector<ForwardIndex::Entry>> document_terms(documents.size());
+    vector<vector<pair<TermId, uint32_t>>> document_positions(positions_ ? documents.size() : 0);
+    for_each(policy,
+        chunk_indexes.begin(), chunk_indexes.end(),
+        [this, &documents, &document_words, &chunk_postings, &document_terms, &document_positions, first_ordinal, chunk_size](size_t chunk_index) {
+            const size_t begin = min(documents.size(), chunk_index * chunk_size);
+            const size_t end = min(documents.size(), begin + chunk_size);
+            auto& postings = chunk_postings[chunk_index];
+            for (size_t index = begin; index < end; ++index) {
+                const DocumentWords& words = document_words[index];
+                const int ordinal = first_ordinal + static_cast<int>(index);
+                for (size_t i = 0; i < words.term_ids.size(); ++i) {
+                    const TermId term_id = words.term_ids[i];
+                    const uint32_t word_count = words.word_counts[i].second;
+                    postings.push_back({term_id, Posting{ordinal, word_count}});
+                    document_terms[index].push_back({term_id, word_count});
+                }
+                sort(document_terms[index].begin(), document_terms[index].end(), [](const ForwardIndex::Entry& lhs, const ForwardIndex::Entry& rhs) {
+                    return lhs.term_id < rhs.term_id;
+                });
+                if (positions_) {
+                    document_positions[index] = FindTermPositions(words.words, words.positions);
+                }
+            }
+            stable_sort(postings.begin(), postings.end(), [](const auto& lhs, const auto& rhs) {
+                return lhs.first < rhs.first;
+            });
+        });
+
+    const size_t term_count = term_entries_.size();
+    const size_t term_chunk_size = (term_count + chunk_count - 1) / chunk_count;
+    for_each(policy,
+        chunk_indexes.begin(), chunk_indexes.end(),
+        [this, &chunk_postings, term_count, term_chunk_size](size_t chunk_index) {
+            const TermId begin_term = static_cast<TermId>(min(term_count, chunk_index * term_chunk_size));
+            const TermId end_term = static_cast<TermId>(min(term_count, (chunk_index + 1) * term_chunk_size));
+            // chunks cover ascending ordinal ranges, so appending them in order keeps lists sorted
+            for (const auto& postings : chunk_postings) {
+                auto it = lower_bound(postings.begin(), postings.end(), begin_term, [](const auto& entry, TermId term_id) {
+                    return entry.first < term_id;
+                });
+                for (; it != postings.end() && it->first < end_term; ++it) {
+                    const Posting& posting = it->second;
+                    TermEntry& term_entry = term_entries_[it->first];
+                    term_entry.buffered_postings.Append(posting.document_ordinal, posting.word_count);
+                    term_entry.max_term_freq = max(term_entry.max_term_freq, posting.word_count * ordinals_[posting.document_ordinal].inv_word_count);
+                    ++term_entry.document_count;
+                    if (next(it) == postings.end() || next(it)->first != it->first) {
+                        UpdateDocumentFreq(term_entry);
+                    }
+                }
+            }
+        });
+
+    for (size_t index = 0; index < documents.size(); ++index) {
+        forward_index_.Append(document_terms[index]);
+        if (positions_) {
+            positions_->Append(document_positions[index]);
+        }
+        buffered_posting_count_ += document_terms[index].size();
+    }
+    if (buffered_posting_count_ >= write_buffer_capacity_) {
+        SealWriteBuffer();
+    }
+    ++generation_;
+    MetricsRegistry::GetInstance().Add(MetricCounter::DOCUMENTS_ADDED, documents.size());
+}
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    AddDocuments(execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const execution::sequenced_policy& policy, const vector<NewDocument>& documents) {
+    AddDocumentBatch(policy, documents);
+}
+
+void SearchServer::AddDocuments(const execution::parallel_policy& policy, const vector<NewDocument>& documents) {
+    AddDocumentBatch(policy, documents);
 }
 
 void SearchServer::RemoveDocument(int document_id) { //les12
+    if (replicas_) {
+        ChangeReplicas([document_id](SearchServer& replica) {
+            replica.RemoveDocument(document_id);
+        });
+        return;
+    }
+    InstallMerge(false);
     if (document_ids_.count(document_id) == 1) {
-        
-        for (auto [word, freq] : GetWordFrequencies(document_id)) {
-            word_to_document_freqs_[word].erase(document_id);
-            }
-        
-        document_ids_.erase(document_id);
-        documents_.erase(document_id);
-        document_words_freqs_.erase(document_id);
+        TIME_STAGE(MetricStage::REMOVE_DOCUMENT);
+        MarkDocumentRemoved(document_id);
+        ++generation_;
+        MetricsRegistry::GetInstance().Add(MetricCounter::DOCUMENTS_REMOVED);
     }
     return;
 }
@@ -45,73 +301,559 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int d
  }
  
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
-    if (document_words_freqs_.count(document_id) == 0) {
+    RemoveDocument(document_id);
+}
+
+void SearchServer::RemoveDocumentBatch(const vector<int>& document_ids) {
+    if (replicas_) {
+        ChangeReplicas([&document_ids](SearchServer& replica) {
+            replica.RemoveDocumentBatch(document_ids);
+        });
+        return;
+    }
+    InstallMerge(false);
+    vector<int> removed_ids;
+    removed_ids.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        if (document_ids_.count(document_id) == 1) {
+            removed_ids.push_back(document_id);
+        }
+    }
+    sort(removed_ids.begin(), removed_ids.end());
+    removed_ids.erase(unique(removed_ids.begin(), removed_ids.end()), removed_ids.end());
+    if (removed_ids.empty()) {
         return;
     }
+    TIME_STAGE(MetricStage::REMOVE_DOCUMENT);
+    for (const int document_id : removed_ids) {
+        MarkDocumentRemoved(document_id);
+    }
+    ++generation_;
+    MetricsRegistry::GetInstance().Add(MetricCounter::DOCUMENTS_REMOVED, removed_ids.size());
+}
 
+// Only the counts of the document's terms change; its postings are dropped by the next merge
+// of its segment, or of the write buffer once sealed
+void SearchServer::MarkDocumentRemoved(int document_id) {
+    const auto document = documents_.find(document_id);
+    const int ordinal = document->second.ordinal;
+    for (const ForwardIndex::Entry& entry : forward_index_.GetTerms(ordinal)) {
+        TermEntry& term_entry = term_entries_[entry.term_id];
+        --term_entry.document_count;
+        UpdateDocumentFreq(term_entry);
+    }
+    forward_index_.Remove(ordinal);
+    if (positions_) {
+        positions_->Remove(ordinal);
+    }
+    ordinals_[ordinal].document_id = -1;
+    if (ordinal >= buffer_begin_ordinal_) {
+        ++buffer_removed_count_;
+    } else {
+        ++segments_[FindSegmentSlot(ordinal)].removed_count;
+    }
+    const string_view text = document->second.data;
+    documents_.erase(document);
+    ReleaseDocumentText(text);
     document_ids_.erase(document_id);
-    documents_.erase(document_id);
-    document_words_freqs_.erase(document_id);
-
-    const auto& word_freqs = document_words_freqs_.at(document_id);
-    vector<string> words(word_freqs.size());
-    transform(
-        execution::par,
-        word_freqs.begin(), word_freqs.end(),
-        words.begin(),
-        [](const auto& item) { return item.first; }
-    );
-    for_each(
-        execution::par,
-        words.begin(), words.end(),
-        [this, document_id](string word) {
-            word_to_document_freqs_.at(word).erase(document_id);
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    RemoveDocuments(execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(const execution::sequenced_policy&, const vector<int>& document_ids) {
+    RemoveDocumentBatch(document_ids);
+}
+
+void SearchServer::RemoveDocuments(const execution::parallel_policy&, const vector<int>& document_ids) {
+    RemoveDocumentBatch(document_ids);
+}
+
+// The write buffer is sealed even when all its documents are removed, so the ordinal ranges
+// of the segments stay adjacent
+void SearchServer::SealWriteBuffer() {
+    const int end_ordinal = static_cast<int>(ordinals_.size());
+    if (end_ordinal == buffer_begin_ordinal_) {
+        return;
+    }
+    vector<TermId> term_ids;
+    vector<PostingList> postings;
+    for (TermId term_id = 0; term_id < static_cast<TermId>(term_entries_.size()); ++term_id) {
+        PostingList& buffered_postings = term_entries_[term_id].buffered_postings;
+        if (!buffered_postings.empty()) {
+            term_ids.push_back(term_id);
+            postings.push_back(move(buffered_postings));
+            buffered_postings = PostingList();
+        }
+    }
+    segments_.push_back({make_shared<const IndexSegment>(buffer_begin_ordinal_, end_ordinal, move(term_ids), move(postings)), buffer_removed_count_});
+    buffer_begin_ordinal_ = end_ordinal;
+    buffered_posting_count_ = 0;
+    buffer_removed_count_ = 0;
+    ScheduleMerge();
+}
+
+// Segments are tiered by size: a segment of tier t holds about kSegmentMergeFactor^t write
+// buffers. kSegmentMergeFactor adjacent segments of one tier are merged into one of the next
+// tier, so every posting is rewritten a logarithmic number of times. A segment that is mostly
+// removed documents is rewritten on its own.
+void SearchServer::ScheduleMerge() {
+    if (pending_merge_.valid()) {
+        return;
+    }
+    const auto get_tier = [this](const SegmentSlot& slot) {
+        size_t tier = 0;
+        for (size_t size = slot.segment->GetPostingCount() / write_buffer_capacity_; size >= kSegmentMergeFactor; size /= kSegmentMergeFactor) {
+            ++tier;
+        }
+        return tier;
+    };
+    size_t run_begin = 0;
+    for (size_t slot = 0; slot < segments_.size(); ++slot) {
+        if (get_tier(segments_[slot]) != get_tier(segments_[run_begin])) {
+            run_begin = slot;
+        }
+        if (slot + 1 - run_begin == kSegmentMergeFactor) {
+            StartMerge(run_begin, kSegmentMergeFactor);
+            return;
+        }
+    }
+    for (size_t slot = 0; slot < segments_.size(); ++slot) {
+        const IndexSegment& segment = *segments_[slot].segment;
+        if (2 * segments_[slot].removed_count > segment.GetEndOrdinal() - segment.GetBeginOrdinal()) {
+            StartMerge(slot, 1);
+            return;
+        }
+    }
+}
+
+void SearchServer::StartMerge(size_t first_slot, size_t slot_count) {
+    vector<shared_ptr<const IndexSegment>> segments;
+    merge_removed_count_ = 0;
+    for (size_t slot = first_slot; slot < first_slot + slot_count; ++slot) {
+        segments.push_back(segments_[slot].segment);
+        merge_removed_count_ += segments_[slot].removed_count;
+    }
+    // documents removed while the merge runs stay counted in the merged segment
+    const int begin_ordinal = segments.front()->GetBeginOrdinal();
+    const int end_ordinal = segments.back()->GetEndOrdinal();
+    vector<bool> is_removed(end_ordinal - begin_ordinal);
+    for (int ordinal = begin_ordinal; ordinal < end_ordinal; ++ordinal) {
+        is_removed[ordinal - begin_ordinal] = ordinals_[ordinal].document_id < 0;
+    }
+    merge_first_slot_ = first_slot;
+    merge_slot_count_ = slot_count;
+    // a merge repeated on the second replica is not counted again
+    const bool is_counted = MetricsRegistry::GetInstance().IsEnabled();
+    pending_merge_ = async(launch::async, [segments = move(segments), is_removed = move(is_removed), is_counted] {
+        const auto merge = [&segments, &is_removed] {
+            TIME_STAGE(MetricStage::SEGMENT_MERGE);
+            vector<const IndexSegment*> inputs;
+            for (const auto& segment : segments) {
+                inputs.push_back(segment.get());
+            }
+            return make_shared<const IndexSegment>(IndexSegment::Merge(inputs, is_removed));
+        };
+        if (is_counted) {
+            return merge();
+        }
+        MetricsPause pause;
+        return merge();
+    });
+}
+
+void SearchServer::InstallMerge(bool wait) {
+    if (!pending_merge_.valid()
+        || (!wait && pending_merge_.wait_for(chrono::seconds(0)) != future_status::ready)) {
+        return;
+    }
+    SegmentSlot merged{pending_merge_.get(), -merge_removed_count_};
+    const auto first = segments_.begin() + merge_first_slot_;
+    for (auto it = first; it != first + merge_slot_count_; ++it) {
+        merged.removed_count += it->removed_count;
+    }
+    *first = move(merged);
+    segments_.erase(first + 1, first + merge_slot_count_);
+    ScheduleMerge();
+}
+
+size_t SearchServer::FindSegmentSlot(int ordinal) const {
+    const auto it = upper_bound(segments_.begin(), segments_.end(), ordinal, [](int ordinal, const SegmentSlot& slot) {
+        return ordinal < slot.segment->GetBeginOrdinal();
+    });
+    return it - segments_.begin() - 1;
+}
+
+void SearchServer::SetWriteBufferCapacity(size_t posting_count) {
+    if (replicas_) {
+        ChangeReplicas([posting_count](SearchServer& replica) {
+            replica.SetWriteBufferCapacity(posting_count);
         });
+        return;
+    }
+    write_buffer_capacity_ = max<size_t>(1, posting_count);
+    if (buffered_posting_count_ >= write_buffer_capacity_) {
+        SealWriteBuffer();
+    }
+}
+
+void SearchServer::CompactIndex() {
+    if (replicas_) {
+        ChangeReplicas([](SearchServer& replica) {
+            replica.CompactIndex();
+        });
+        return;
+    }
+    SealWriteBuffer();
+    while (pending_merge_.valid()) {
+        InstallMerge(true);
+    }
+    const bool has_removed = any_of(segments_.begin(), segments_.end(), [](const SegmentSlot& slot) {
+        return slot.removed_count > 0;
+    });
+    if (segments_.size() > 1 || has_removed) {
+        StartMerge(0, segments_.size());
+        InstallMerge(true);
+        // nothing is left to merge, so InstallMerge scheduled no new merge
+    }
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status) const {
     return FindTopDocuments(execution::seq, raw_query, status);
 }
 
+vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, DocumentStatus status, size_t max_count) const {
+    return FindTopDocuments(execution::seq, raw_query, status, max_count);
+}
+
 vector<Document> SearchServer::FindTopDocuments(const string_view raw_query) const {
     return FindTopDocuments(execution::seq, raw_query);
 }
 
 
+SearchPage SearchServer::FindTopDocumentsPage(const string_view raw_query, DocumentStatus status, size_t offset, size_t limit) const {
+    return FindTopDocumentsPage(execution::seq, raw_query, status, offset, limit);
+}
+
+SearchPage SearchServer::FindNextDocumentsPage(const string_view raw_query, DocumentStatus status, const string& cursor, size_t limit) const {
+    return FindNextDocumentsPage(execution::seq, raw_query, status, cursor, limit);
+}
+
+SearchPage SearchServer::MakeSearchPage(vector<Document> documents, size_t offset, size_t limit) {
+    SearchPage page;
+    const size_t page_end = offset + limit;
+    if (documents.size() > page_end && page_end > 0) {
+        page.next_cursor = EncodeSearchCursor(documents[page_end - 1]);
+    }
+    documents.resize(min(documents.size(), page_end));
+    documents.erase(documents.begin(), documents.begin() + min(documents.size(), offset));
+    page.documents = move(documents);
+    return page;
+}
+
+// The relevance is kept bit for bit, so the cursor compares exactly like the document did
+string SearchServer::EncodeSearchCursor(const Document& document) {
+    uint64_t relevance_bits;
+    memcpy(&relevance_bits, &document.relevance, sizeof(relevance_bits));
+    char buffer[64];
+    const int length = snprintf(buffer, sizeof(buffer), "%016" PRIx64 ".%d.%d", relevance_bits, document.rating, document.id);
+    return string(buffer, length);
+}
+
+Document SearchServer::DecodeSearchCursor(const string& cursor) {
+    uint64_t relevance_bits = 0;
+    Document document;
+    const char* const end = cursor.data() + cursor.size();
+    auto result = from_chars(cursor.data(), end, relevance_bits, 16);
+    bool is_valid = result.ec == errc() && result.ptr != end && *result.ptr == '.';
+    if (is_valid) {
+        result = from_chars(result.ptr + 1, end, document.rating);
+        is_valid = result.ec == errc() && result.ptr != end && *result.ptr == '.';
+    }
+    if (is_valid) {
+        result = from_chars(result.ptr + 1, end, document.id);
+        is_valid = result.ec == errc() && result.ptr == end;
+    }
+    memcpy(&document.relevance, &relevance_bits, sizeof(relevance_bits));
+    if (!is_valid || !isfinite(document.relevance)) {
+        throw invalid_argument("Search cursor "s + cursor + " is invalid"s);
+    }
+    return document;
+}
+
 int SearchServer:: GetDocumentCount() const {
+    if (replicas_) {
+        return replicas_->Read([](const SearchServer& replica) {
+            return replica.GetDocumentCount();
+        });
+    }
     return documents_.size();
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const { //les12
-    if (document_ids_.count(document_id) == 1) {
-        return document_words_freqs_.at(document_id);
+void SearchServer::SetQueryEvaluation(QueryEvaluation query_evaluation) {
+    if (replicas_) {
+        ChangeReplicas([query_evaluation](SearchServer& replica) {
+            replica.SetQueryEvaluation(query_evaluation);
+        });
+    }
+    query_evaluation_ = query_evaluation;
+}
+
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+    if (capacity == 0) {
+        result_cache_.reset();
+    } else {
+        result_cache_ = make_unique<QueryResultCache>(capacity);
+    }
+}
+
+void SearchServer::EnablePositions() {
+    if (replicas_) {
+        ChangeReplicas([](SearchServer& replica) {
+            replica.EnablePositions();
+        });
+        return;
+    }
+    if (positions_) {
+        return;
+    }
+    positions_ = make_unique<PositionIndex>();
+    vector<string_view> words;
+    vector<uint32_t> positions;
+    for (const OrdinalEntry& entry : ordinals_) {
+        if (entry.document_id < 0) {
+            positions_->Append({});
+            continue;
+        }
+        SplitIntoWordsNoStop(documents_.at(entry.document_id).data, words, &positions);
+        positions_->Append(FindTermPositions(words, positions));
     }
-    static map<string_view, double> empty_map;
-    return empty_map;
+}
+
+QueryResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_ ? result_cache_->GetStats() : QueryResultCache::Stats{};
+}
+
+namespace {
+
+// Status and rating of ordinals are restored from the document records
+struct OrdinalRecord {
+    int32_t document_id;
+    double inv_word_count;
+};
+
+struct DocumentRecord {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    int32_t ordinal;
+};
+
+} // namespace
+
+// Layout: stop words, ordinal table, document records and texts, terms, then the posting
+// list of every term in term id order
+void SearchServer::SaveIndex(const string& path) const {
+    if (replicas_) {
+        replicas_->Read([&path](const SearchServer& replica) {
+            replica.SaveIndex(path);
+        });
+        return;
+    }
+    IndexFileWriter writer(path);
+    writer.WriteStrings(vector<string_view>(stop_words_.begin(), stop_words_.end()));
+
+    vector<OrdinalRecord> ordinal_records(ordinals_.size(), OrdinalRecord{});
+    for (size_t ordinal = 0; ordinal < ordinals_.size(); ++ordinal) {
+        ordinal_records[ordinal].document_id = ordinals_[ordinal].document_id;
+        ordinal_records[ordinal].inv_word_count = ordinals_[ordinal].inv_word_count;
+    }
+    writer.WriteValue<uint64_t>(ordinal_records.size());
+    writer.WriteArray(ordinal_records.data(), ordinal_records.size());
+
+    vector<DocumentRecord> records;
+    vector<string_view> texts;
+    records.reserve(documents_.size());
+    texts.reserve(documents_.size());
+    for (const auto& [document_id, document_data] : documents_) {
+        records.push_back({document_id, document_data.rating, static_cast<int32_t>(document_data.status), document_data.ordinal});
+        texts.push_back(document_data.data);
+    }
+    writer.WriteValue<uint64_t>(records.size());
+    writer.WriteArray(records.data(), records.size());
+    writer.WriteStrings(texts);
+
+    vector<string_view> terms;
+    terms.reserve(terms_.size());
+    for (TermId term_id = 0; term_id < static_cast<TermId>(terms_.size()); ++term_id) {
+        terms.push_back(terms_.GetTerm(term_id));
+    }
+    writer.WriteStrings(terms);
+    // the postings of every term are gathered from the segments and the write buffer into one
+    // list, leaving out removed documents, so a loaded index starts as a single segment
+    for (TermId term_id = 0; term_id < static_cast<TermId>(term_entries_.size()); ++term_id) {
+        writer.WriteValue(term_entries_[term_id].max_term_freq);
+        PostingList postings;
+        const auto append_live = [this, &postings](const Posting& posting) {
+            if (ordinals_[posting.document_ordinal].document_id >= 0) {
+                postings.Append(posting.document_ordinal, posting.word_count);
+            }
+        };
+        for (const SegmentSlot& slot : segments_) {
+            if (const PostingList* segment_postings = slot.segment->FindPostings(term_id)) {
+                segment_postings->ForEach(append_live);
+            }
+        }
+        term_entries_[term_id].buffered_postings.ForEach(append_live);
+        postings.Save(writer);
+    }
+    writer.Finish();
+}
+
+SearchServer SearchServer::LoadIndex(const string& path) {
+    IndexFileReader reader(path);
+    SearchServer search_server(reader.ReadStrings());
+    search_server.index_file_ = reader.GetMapping();
+    const auto check = [](bool condition) {
+        if (!condition) {
+            throw invalid_argument("Index file is damaged"s);
+        }
+    };
+
+    const uint64_t ordinal_count = reader.ReadValue<uint64_t>();
+    check(ordinal_count <= static_cast<uint64_t>(numeric_limits<int>::max()));
+    const OrdinalRecord* const ordinal_records = reader.ReadArray<OrdinalRecord>(ordinal_count);
+    search_server.ordinals_.reserve(ordinal_count);
+    for (uint64_t ordinal = 0; ordinal < ordinal_count; ++ordinal) {
+        search_server.ordinals_.push_back({ordinal_records[ordinal].document_id, DocumentStatus::ACTUAL, ordinal_records[ordinal].inv_word_count, 0});
+    }
+
+    const uint64_t document_count = reader.ReadValue<uint64_t>();
+    const DocumentRecord* const records = reader.ReadArray<DocumentRecord>(document_count);
+    const vector<string_view> texts = reader.ReadStrings();
+    check(texts.size() == document_count);
+    for (uint64_t index = 0; index < document_count; ++index) {
+        const DocumentRecord& record = records[index];
+        check(record.ordinal >= 0 && static_cast<uint64_t>(record.ordinal) < ordinal_count
+            && search_server.ordinals_[record.ordinal].document_id == record.id
+            && record.status >= 0 && record.status <= static_cast<int32_t>(DocumentStatus::REMOVED));
+        const bool inserted = search_server.documents_.emplace(record.id,
+            DocumentData{record.rating, static_cast<DocumentStatus>(record.status), search_server.StoreDocumentText(texts[index]), record.ordinal}).second;
+        check(inserted);
+        search_server.ordinals_[record.ordinal].status = static_cast<DocumentStatus>(record.status);
+        search_server.ordinals_[record.ordinal].rating = record.rating;
+        search_server.document_ids_.insert(record.id);
+    }
+
+    vector<TermId> term_ids;
+    vector<PostingList> term_postings;
+    // terms of documents are restored from the postings, without tokenizing
+    vector<vector<ForwardIndex::Entry>> document_terms(ordinal_count);
+    for (const string_view term : reader.ReadStrings()) {
+        const TermId term_id = search_server.terms_.InternView(term);
+        check(term_id == static_cast<TermId>(search_server.term_entries_.size()));
+        TermEntry& term_entry = search_server.term_entries_.emplace_back();
+        term_entry.max_term_freq = reader.ReadValue<double>();
+        PostingList postings = PostingList::Load(reader, static_cast<int>(ordinal_count));
+        term_entry.document_count = static_cast<int>(postings.size());
+        UpdateDocumentFreq(term_entry);
+        int previous_ordinal = -1;
+        postings.ForEach([&search_server, &check, &previous_ordinal, &document_terms, term_id, ordinal_count](const Posting& posting) {
+            check(posting.document_ordinal > previous_ordinal && static_cast<uint64_t>(posting.document_ordinal) < ordinal_count);
+            previous_ordinal = posting.document_ordinal;
+            const auto it = search_server.documents_.find(search_server.ordinals_[posting.document_ordinal].document_id);
+            check(it != search_server.documents_.end() && it->second.ordinal == posting.document_ordinal);
+            document_terms[posting.document_ordinal].push_back({term_id, posting.word_count});
+        });
+        if (!postings.empty()) {
+            term_ids.push_back(term_id);
+            term_postings.push_back(move(postings));
+            postings = PostingList();
+        }
+    }
+    check(reader.IsEnd());
+    for (const vector<ForwardIndex::Entry>& terms : document_terms) {
+        search_server.forward_index_.Append(terms);
+    }
+    if (ordinal_count > 0) {
+        search_server.segments_.push_back({make_shared<const IndexSegment>(0, static_cast<int>(ordinal_count), move(term_ids), move(term_postings)), 0});
+    }
+    search_server.buffer_begin_ordinal_ = static_cast<int>(ordinal_count);
+    return search_server;
+}
+
+map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const { //les12
+    if (replicas_) {
+        return replicas_->Read([document_id](const SearchServer& replica) {
+            return replica.GetWordFrequencies(document_id);
+        });
+    }
+    map<string_view, double> word_freqs;
+    const auto document = documents_.find(document_id);
+    if (document != documents_.end()) {
+        const int ordinal = document->second.ordinal;
+        for (const ForwardIndex::Entry& entry : forward_index_.GetTerms(ordinal)) {
+            // views into the dictionary outlive the document text
+            word_freqs.emplace(terms_.GetTerm(entry.term_id), entry.word_count * ordinals_[ordinal].inv_word_count);
+        }
+    }
+    return word_freqs;
+}
+
+vector<TermId> SearchServer::GetWordIds(int document_id) const {
+    if (replicas_) {
+        return replicas_->Read([document_id](const SearchServer& replica) {
+            return replica.GetWordIds(document_id);
+        });
+    }
+    vector<TermId> term_ids;
+    const auto document = documents_.find(document_id);
+    if (document != documents_.end()) {
+        for (const ForwardIndex::Entry& entry : forward_index_.GetTerms(document->second.ordinal)) {
+            term_ids.push_back(entry.term_id);
+        }
+    }
+    return term_ids;
 }
 
 set<int>::const_iterator SearchServer::begin() const { // new
+    if (replicas_) {
+        return replicas_->Read([](const SearchServer& replica) {
+            return replica.begin();
+        });
+    }
     return document_ids_.begin();
 }
 
 set<int>::const_iterator SearchServer::end() const { // new les 12
+    if (replicas_) {
+        return replicas_->Read([](const SearchServer& replica) {
+            return replica.end();
+        });
+    }
     return document_ids_.end();
 }
 
 
  
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, const string_view raw_query, int document_id) const {
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy& policy, const string_view raw_query, int document_id) const {
+    if (replicas_) {
+        return replicas_->Read([&policy, raw_query, document_id](const SearchServer& replica) {
+            return replica.MatchDocument(policy, raw_query, document_id);
+        });
+    }
     bool sorting = true;
     const Query query = ParseQuery(raw_query, sorting);
+    const int ordinal = documents_.at(document_id).ordinal;
     const auto word_checker =
-        [this, document_id](string_view word) {
-            const auto it = word_to_document_freqs_.find(word);
-            return it != word_to_document_freqs_.end()&& it->second.count(document_id);
+        [this, ordinal](string_view word) {
+            const TermId term_id = terms_.Find(word);
+            return term_id != kNoTerm && forward_index_.GetWordCount(ordinal, term_id) > 0;
         };
 
-    if (any_of(execution::par,
-        query.minus_words.begin(), query.minus_words.end(),
-        word_checker)) {
+    if (any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), word_checker)
+        || !MatchesProximity(ResolveProximity(query), ordinal)) {
         vector<string_view> empty;
         return { empty, documents_.at(document_id).status };
     }
@@ -134,23 +876,27 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const str
 }
  
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy&, const string_view raw_query, int document_id) const {
-    
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy& policy, const string_view raw_query, int document_id) const {
+    if (replicas_) {
+        return replicas_->Read([&policy, raw_query, document_id](const SearchServer& replica) {
+            return replica.MatchDocument(policy, raw_query, document_id);
+        });
+    }
     if (document_ids_.count(document_id) == 0) {
         return { {}, {} };
     }
     const Query query = ParseQuery(raw_query);
+    const int ordinal = documents_.at(document_id).ordinal;
 
     const auto word_checker =
-        [this, document_id](string_view word) {
-            const auto it = word_to_document_freqs_.find(word);
-            return it != word_to_document_freqs_.end() && it->second.count(document_id);
+        [this, ordinal](string_view word) {
+            const TermId term_id = terms_.Find(word);
+            return term_id != kNoTerm && forward_index_.GetWordCount(ordinal, term_id) > 0;
         };
 
 
-    if (any_of(execution::seq,
-        query.minus_words.begin(), query.minus_words.end(),
-        word_checker)) {
+    if (any_of(execution::seq, query.minus_words.begin(), query.minus_words.end(), word_checker)
+        || !MatchesProximity(ResolveProximity(query), ordinal)) {
         vector<string_view> empty;
         return { empty, documents_.at(document_id).status };
     }
@@ -169,6 +915,82 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
 }
 
 
+// The query words are looked up once; each document's sorted term array is then intersected
+// with the sorted plus term ids in a single merge
+template <typename Policy>
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocumentBatch(Policy& policy, const string_view raw_query, const vector<int>& document_ids) const {
+    if (replicas_) {
+        return replicas_->Read([&policy, raw_query, &document_ids](const SearchServer& replica) {
+            return replica.MatchDocumentBatch(policy, raw_query, document_ids);
+        });
+    }
+    const Query query = ParseQuery(raw_query, true);
+    // plus terms by id, with the position of their word in the sorted query
+    vector<pair<TermId, size_t>> plus_terms;
+    for (size_t index = 0; index < query.plus_words.size(); ++index) {
+        const TermId term_id = terms_.Find(query.plus_words[index]);
+        if (term_id != kNoTerm) {
+            plus_terms.emplace_back(term_id, index);
+        }
+    }
+    sort(plus_terms.begin(), plus_terms.end());
+    const vector<TermId> minus_term_ids = FindTermIds(query.minus_words);
+    const ProximityQuery proximity = ResolveProximity(query);
+
+    vector<tuple<vector<string_view>, DocumentStatus>> results(document_ids.size());
+    vector<size_t> indexes(document_ids.size());
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(policy,
+        indexes.begin(), indexes.end(),
+        [this, &query, &plus_terms, &minus_term_ids, &proximity, &document_ids, &results](size_t index) {
+            const auto document = documents_.find(document_ids[index]);
+            if (document == documents_.end()) {
+                return;
+            }
+            const int ordinal = document->second.ordinal;
+            auto& [matched_words, status] = results[index];
+            status = document->second.status;
+            const bool is_excluded = any_of(minus_term_ids.begin(), minus_term_ids.end(), [this, ordinal](TermId term_id) {
+                return forward_index_.GetWordCount(ordinal, term_id) > 0;
+            });
+            if (is_excluded || !MatchesProximity(proximity, ordinal)) {
+                return;
+            }
+            const ForwardIndex::Terms terms = forward_index_.GetTerms(ordinal);
+            vector<size_t> matched_indexes;
+            auto term = terms.begin();
+            for (const auto& [term_id, word_index] : plus_terms) {
+                while (term != terms.end() && term->term_id < term_id) {
+                    ++term;
+                }
+                if (term == terms.end()) {
+                    break;
+                }
+                if (term->term_id == term_id) {
+                    matched_indexes.push_back(word_index);
+                }
+            }
+            sort(matched_indexes.begin(), matched_indexes.end());
+            matched_words.reserve(matched_indexes.size());
+            for (const size_t word_index : matched_indexes) {
+                matched_words.push_back(query.plus_words[word_index]);
+            }
+        });
+    return results;
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(execution::seq, raw_query, document_ids);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const execution::sequenced_policy& policy, const string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocumentBatch(policy, raw_query, document_ids);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const execution::parallel_policy& policy, const string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocumentBatch(policy, raw_query, document_ids);
+}
+
 bool SearchServer::IsStopWord(const string_view word) const {
     return stop_words_.count(word) > 0;
 }
@@ -180,17 +1002,69 @@ bool SearchServer::IsValidWord(const string_view word) {
     });
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view text) const {
-    vector<string_view> words;
-    for (const string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + string(word) + " is invalid"s);
+// Empty words between consecutive spaces take no position
+void SearchServer::SplitIntoWordsNoStop(const string_view text, vector<string_view>& words, vector<uint32_t>* positions) const {
+    const size_t invalid_word_index = SplitIntoWords(text, words);
+    if (invalid_word_index < words.size()) {
+        throw invalid_argument("Word "s + string(words[invalid_word_index]) + " is invalid"s);
+    }
+    if (positions) {
+        positions->clear();
+        uint32_t position = 0;
+        for (const string_view word : words) {
+            positions->push_back(position);
+            if (!word.empty()) {
+                ++position;
+            }
         }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+    }
+    if (stop_words_.empty()) {
+        return;
+    }
+    size_t kept_count = 0;
+    for (size_t index = 0; index < words.size(); ++index) {
+        if (!IsStopWord(words[index])) {
+            words[kept_count] = words[index];
+            if (positions) {
+                (*positions)[kept_count] = (*positions)[index];
+            }
+            ++kept_count;
         }
     }
-    return words;
+    words.resize(kept_count);
+    if (positions) {
+        positions->resize(kept_count);
+    }
+}
+
+vector<pair<TermId, uint32_t>> SearchServer::FindTermPositions(const vector<string_view>& words, const vector<uint32_t>& positions) const {
+    vector<pair<TermId, uint32_t>> term_positions;
+    term_positions.reserve(words.size());
+    for (size_t index = 0; index < words.size(); ++index) {
+        term_positions.emplace_back(terms_.Find(words[index]), positions[index]);
+    }
+    sort(term_positions.begin(), term_positions.end());
+    return term_positions;
+}
+
+string_view SearchServer::StoreDocumentText(string_view text) {
+    live_text_bytes_ += text.size();
+    return document_texts_.Store(text);
+}
+
+// Texts of removed documents stay in the arena until most of it is garbage. Then the live
+// texts are copied into a new arena and the documents are pointed at the copies.
+// The text must already be detached from its document.
+void SearchServer::ReleaseDocumentText(string_view text) {
+    live_text_bytes_ -= text.size();
+    if (2 * live_text_bytes_ >= document_texts_.GetStoredBytes()) {
+        return;
+    }
+    TextArena document_texts;
+    for (auto& [document_id, document_data] : documents_) {
+        document_data.data = document_texts.Store(document_data.data);
+    }
+    document_texts_ = move(document_texts);
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
@@ -202,7 +1076,7 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word, bool is_valid) const {
     if (word.empty()) {
         throw invalid_argument("Query word is empty"s);
     }
@@ -211,25 +1085,105 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
         is_minus = true;
         word.remove_prefix(1);
     }
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    if (word.empty() || word[0] == '-' || !is_valid) {
         throw invalid_argument("Query word "s + string(word) + " is invalid");
     }
     return {word, is_minus, IsStopWord(word)};
 }
  
 
+// A phrase runs from a word starting with a quote to a word ending with one. NEAR/k joins the
+// plus words next to it, a word may be the operand of two operators: a NEAR/2 b NEAR/2 c.
+// Operators with a stop word operand are dropped like stop words are. A word starting or
+// ending with * is replaced by the indexed words it matches.
 SearchServer::Query SearchServer::ParseQuery(const string_view text, bool sorting) const {
+    TIME_STAGE(MetricStage::QUERY_PARSE);
     Query result;
-    for (const string_view word : SplitIntoWords(text)) {
-            const auto query_word = ParseQueryWord(word);
-            if (!query_word.is_stop) {
-                if (query_word.is_minus) {
-                    result.minus_words.push_back(query_word.data);
-                } else {
+    thread_local vector<string_view> words;
+    const size_t invalid_word_index = SplitIntoWords(text, words);
+    optional<QueryPhrase> phrase;
+    int phrase_offset = 0;
+    // the previous word, if it was a plus word outside phrases
+    optional<QueryWord> previous_word;
+    // the left operand and the distance of a NEAR waiting for its right operand
+    optional<pair<QueryWord, int>> pending_near;
+    for (size_t index = 0; index < words.size(); ++index) {
+            string_view word = words[index];
+            if (!phrase && word.substr(0, kNearOperator.size()) == kNearOperator) {
+                if (!previous_word || pending_near) {
+                    throw invalid_argument("Operator "s + string(word) + " needs a word on each side"s);
+                }
+                pending_near.emplace(*previous_word, ParseNearDistance(word));
+                previous_word.reset();
+                continue;
+            }
+            bool closes_phrase = false;
+            if (!phrase && !word.empty() && word.front() == '"') {
+                phrase.emplace();
+                phrase_offset = 0;
+                word.remove_prefix(1);
+            }
+            if (phrase && !word.empty() && word.back() == '"') {
+                closes_phrase = true;
+                word.remove_suffix(1);
+            }
+            // words after the first invalid one are never reached
+            const auto query_word = ParseQueryWord(word, index != invalid_word_index);
+            const bool is_wildcard = IsWildcard(query_word.data);
+            if (phrase) {
+                if (query_word.is_minus || is_wildcard || pending_near) {
+                    throw invalid_argument("Query phrase cannot hold minus words or wildcards or be an operand"s);
+                }
+                if (!query_word.is_stop) {
                     result.plus_words.push_back(query_word.data);
+                    phrase->words.emplace_back(query_word.data, phrase_offset);
+                }
+                ++phrase_offset;
+                if (closes_phrase) {
+                    if (phrase->words.size() > 1) {
+                        result.phrases.push_back(move(*phrase));
+                    }
+                    phrase.reset();
+                }
+                previous_word.reset();
+                continue;
+            }
+            if (is_wildcard) {
+                if (pending_near) {
+                    throw invalid_argument("Wildcard "s + string(query_word.data) + " cannot be an operand"s);
                 }
+                ExpandWildcard(query_word.data, !query_word.is_minus, query_word.is_minus ? result.minus_words : result.plus_words);
+                previous_word.reset();
+                continue;
             }
+            if (query_word.is_minus) {
+                if (pending_near) {
+                    throw invalid_argument("Minus word "s + string(query_word.data) + " cannot be an operand"s);
+                }
+                if (!query_word.is_stop) {
+                    result.minus_words.push_back(query_word.data);
+                }
+                previous_word.reset();
+                continue;
+            }
+            if (!query_word.is_stop) {
+                result.plus_words.push_back(query_word.data);
+            }
+            if (pending_near) {
+                const auto& [lhs, max_distance] = *pending_near;
+                if (!lhs.is_stop && !query_word.is_stop) {
+                    result.nears.push_back({lhs.data, query_word.data, max_distance});
+                }
+                pending_near.reset();
+            }
+            previous_word = query_word;
         }
+    if (phrase) {
+        throw invalid_argument("Query phrase is not closed"s);
+    }
+    if (pending_near) {
+        throw invalid_argument("Operator NEAR needs a word on each side"s);
+    }
     if (sorting) {
         sort(result.plus_words.begin(), result.plus_words.end());
         auto unique_p = unique(result.plus_words.begin(), result.plus_words.end());
@@ -241,7 +1195,282 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text, bool sortin
     return result;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
-    return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+bool SearchServer::IsWildcard(const string_view word) {
+    return word.size() > 1 && (word.front() == '*' || word.back() == '*');
+}
+
+// Prefixes are looked up in the sorted dictionary, other patterns are checked against every
+// term. Only terms with documents are kept.
+void SearchServer::ExpandWildcard(string_view pattern, bool is_capped, vector<string_view>& words) const {
+    const bool is_leading = pattern.front() == '*';
+    const bool is_trailing = pattern.back() == '*';
+    pattern.remove_prefix(is_leading ? 1 : 0);
+    pattern.remove_suffix(is_trailing ? 1 : 0);
+    if (pattern.empty()) {
+        throw invalid_argument("Wildcard matches every word"s);
+    }
+    thread_local vector<TermId> term_ids;
+    term_ids.clear();
+    if (!is_leading) {
+        terms_.FindByPrefix(pattern, term_ids);
+    } else {
+        for (TermId term_id = 0; term_id < static_cast<TermId>(terms_.size()); ++term_id) {
+            const string_view term = terms_.GetTerm(term_id);
+            const bool matches = is_trailing
+                ? term.find(pattern) != string_view::npos
+                : term.size() >= pattern.size() && term.substr(term.size() - pattern.size()) == pattern;
+            if (matches) {
+                term_ids.push_back(term_id);
+            }
+        }
+    }
+    term_ids.erase(remove_if(term_ids.begin(), term_ids.end(), [this](TermId term_id) {
+        return term_entries_[term_id].document_count == 0;
+    }), term_ids.end());
+    if (is_capped && term_ids.size() > kMaxWildcardTerms) {
+        nth_element(term_ids.begin(), term_ids.begin() + kMaxWildcardTerms, term_ids.end(), [this](TermId lhs, TermId rhs) {
+            const int lhs_count = term_entries_[lhs].document_count;
+            const int rhs_count = term_entries_[rhs].document_count;
+            return lhs_count > rhs_count || (lhs_count == rhs_count && lhs < rhs);
+        });
+        term_ids.resize(kMaxWildcardTerms);
+    }
+    sort(term_ids.begin(), term_ids.end());
+    for (const TermId term_id : term_ids) {
+        words.push_back(terms_.GetTerm(term_id));
+    }
+}
+
+int SearchServer::ParseNearDistance(string_view word) {
+    word.remove_prefix(kNearOperator.size());
+    int max_distance = 0;
+    const auto [end, error] = from_chars(word.data(), word.data() + word.size(), max_distance);
+    if (word.empty() || error != errc() || end != word.data() + word.size() || max_distance < 0) {
+        throw invalid_argument("Operator NEAR/"s + string(word) + " is invalid"s);
+    }
+    return max_distance;
+}
+
+string SearchServer::NormalizeQuery(Query& query) {
+    sort(query.plus_words.begin(), query.plus_words.end());
+    sort(query.minus_words.begin(), query.minus_words.end());
+    query.minus_words.erase(unique(query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
+    string key;
+    for (const string_view word : query.plus_words) {
+        key.append(word).push_back(' ');
+    }
+    // control characters are not allowed in words, so the separator is unambiguous
+    key.push_back('\x01');
+    for (const string_view word : query.minus_words) {
+        key.append(word).push_back(' ');
+    }
+    for (const QueryPhrase& phrase : query.phrases) {
+        key.push_back('\x03');
+        for (const auto& [word, offset] : phrase.words) {
+            key.append(word).push_back(' ');
+            key += to_string(offset);
+            key.push_back(' ');
+        }
+    }
+    for (const QueryNear& near : query.nears) {
+        key.push_back('\x04');
+        key.append(near.lhs).push_back(' ');
+        key.append(near.rhs).push_back(' ');
+        key += to_string(near.max_distance);
+    }
+    return key;
+}
+
+string SearchServer::MakeResultCacheKey(string query_key, DocumentStatus status, size_t max_count) {
+    query_key.push_back('\x02');
+    query_key += to_string(static_cast<int>(status));
+    query_key.push_back(' ');
+    query_key += to_string(max_count);
+    return query_key;
+}
+
+SearchServer::ResolvedQuery SearchServer::ResolveQuery(const Query& query) const {
+    return ResolveQuery(FindTermIds(query.plus_words), FindTermIds(query.minus_words), ResolveProximity(query));
+}
+
+SearchServer::ResolvedQuery SearchServer::ResolveQuery(vector<TermId> plus_term_ids, const vector<TermId>& minus_term_ids, ProximityQuery proximity) const {
+    ResolvedQuery result;
+    if (!proximity.IsSatisfiable()) {
+        return result;
+    }
+    result.proximity = move(proximity);
+    const double log_document_count = log(GetDocumentCount());
+    vector<TermId> term_ids;
+    sort(plus_term_ids.begin(), plus_term_ids.end());
+    for (auto it = plus_term_ids.begin(); it != plus_term_ids.end();) {
+        const auto next = upper_bound(it, plus_term_ids.end(), *it);
+        const TermEntry& term_entry = term_entries_[*it];
+        if (term_entry.document_count > 0) {
+            // a word repeated in the query counts as many times as it occurs
+            result.plus_terms.push_back({&term_entry, (next - it) * (log_document_count - term_entry.log_document_freq)});
+            term_ids.push_back(*it);
+        }
+        it = next;
+    }
+    vector<TermId> minus_ids;
+    for (const TermId term_id : minus_term_ids) {
+        if (term_entries_[term_id].document_count > 0) {
+            minus_ids.push_back(term_id);
+        }
+    }
+    sort(minus_ids.begin(), minus_ids.end());
+    minus_ids.erase(unique(minus_ids.begin(), minus_ids.end()), minus_ids.end());
+    if (term_ids.empty()) {
+        return result;
+    }
+
+    const auto add_segment = [&result, &term_ids, &minus_ids](int begin_ordinal, int end_ordinal, const auto& find_postings) {
+        SegmentQuery segment{begin_ordinal, end_ordinal, {}, {}};
+        bool has_plus_terms = false;
+        for (const TermId term_id : term_ids) {
+            segment.plus_postings.push_back(find_postings(term_id));
+            has_plus_terms = has_plus_terms || segment.plus_postings.back() != nullptr;
+        }
+        if (!has_plus_terms) {
+            return;
+        }
+        for (const TermId term_id : minus_ids) {
+            if (const PostingList* postings = find_postings(term_id)) {
+                segment.minus_postings.push_back(postings);
+            }
+        }
+        result.segments.push_back(move(segment));
+    };
+    for (const SegmentSlot& slot : segments_) {
+        add_segment(slot.segment->GetBeginOrdinal(), slot.segment->GetEndOrdinal(), [&slot](TermId term_id) {
+            return slot.segment->FindPostings(term_id);
+        });
+    }
+    add_segment(buffer_begin_ordinal_, static_cast<int>(ordinals_.size()), [this](TermId term_id) {
+        return FindBufferedPostings(term_id);
+    });
+    return result;
+}
+
+bool SearchServer::ProximityQuery::empty() const {
+    return phrases.empty() && nears.empty();
+}
+
+bool SearchServer::ProximityQuery::IsSatisfiable() const {
+    for (const auto& phrase : phrases) {
+        for (const auto& [term_id, offset] : phrase) {
+            if (term_id == kNoTerm) {
+                return false;
+            }
+        }
+    }
+    return none_of(nears.begin(), nears.end(), [](const Near& near) {
+        return near.lhs == kNoTerm || near.rhs == kNoTerm;
+    });
+}
+
+SearchServer::ProximityQuery SearchServer::ResolveProximity(const Query& query) const {
+    ProximityQuery result;
+    if (query.phrases.empty() && query.nears.empty()) {
+        return result;
+    }
+    if (!positions_) {
+        throw invalid_argument("Phrase and NEAR queries need positions to be enabled"s);
+    }
+    for (const QueryPhrase& phrase : query.phrases) {
+        auto& terms = result.phrases.emplace_back();
+        for (const auto& [word, offset] : phrase.words) {
+            terms.emplace_back(terms_.Find(word), offset);
+        }
+    }
+    for (const QueryNear& near : query.nears) {
+        result.nears.push_back({terms_.Find(near.lhs), terms_.Find(near.rhs), near.max_distance});
+    }
+    return result;
+}
+
+// A phrase matches where every term is found at the position of the first term shifted by the
+// difference of their offsets; NEAR operands are compared by walking their lists in step
+bool SearchServer::MatchesProximity(const ProximityQuery& proximity, int ordinal) const {
+    if (proximity.empty()) {
+        return true;
+    }
+    thread_local vector<vector<uint32_t>> term_positions;
+    const auto find_positions = [this, ordinal](TermId term_id, vector<uint32_t>& positions) {
+        const int term_index = term_id == kNoTerm ? -1 : forward_index_.FindTerm(ordinal, term_id);
+        if (term_index < 0) {
+            return false;
+        }
+        positions_->GetPositions(ordinal, term_index, positions);
+        return true;
+    };
+    for (const auto& phrase : proximity.phrases) {
+        if (term_positions.size() < phrase.size()) {
+            term_positions.resize(phrase.size());
+        }
+        for (size_t i = 0; i < phrase.size(); ++i) {
+            if (!find_positions(phrase[i].first, term_positions[i])) {
+                return false;
+            }
+        }
+        const bool is_found = any_of(term_positions[0].begin(), term_positions[0].end(), [&phrase](uint32_t first_position) {
+            // offsets grow along the phrase, so no position falls before the first term's
+            for (size_t i = 1; i < phrase.size(); ++i) {
+                const uint32_t position = first_position + (phrase[i].second - phrase[0].second);
+                if (!binary_search(term_positions[i].begin(), term_positions[i].end(), position)) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        if (!is_found) {
+            return false;
+        }
+    }
+    if (term_positions.size() < 2) {
+        term_positions.resize(2);
+    }
+    for (const ProximityQuery::Near& near : proximity.nears) {
+        vector<uint32_t>& lhs = term_positions[0];
+        vector<uint32_t>& rhs = term_positions[1];
+        if (!find_positions(near.lhs, lhs) || !find_positions(near.rhs, rhs)) {
+            return false;
+        }
+        bool is_found = false;
+        for (size_t i = 0, j = 0; !is_found && i < lhs.size() && j < rhs.size();) {
+            // a word does not make a pair with itself
+            const uint32_t distance = lhs[i] < rhs[j] ? rhs[j] - lhs[i] : lhs[i] - rhs[j];
+            is_found = distance <= static_cast<uint32_t>(near.max_distance) && (distance > 0 || near.lhs != near.rhs);
+            if (lhs[i] < rhs[j]) {
+                ++i;
+            } else {
+                ++j;
+            }
+        }
+        if (!is_found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<TermId> SearchServer::FindTermIds(const vector<string_view>& words) const {
+    vector<TermId> term_ids;
+    term_ids.reserve(words.size());
+    for (const string_view word : words) {
+        const TermId term_id = terms_.Find(word);
+        if (term_id != kNoTerm) {
+            term_ids.push_back(term_id);
+        }
+    }
+    return term_ids;
+}
+
+const PostingList* SearchServer::FindBufferedPostings(TermId term_id) const {
+    const PostingList& postings = term_entries_[term_id].buffered_postings;
+    return postings.empty() ? nullptr : &postings;
+}
+
+void SearchServer::UpdateDocumentFreq(TermEntry& term_entry) {
+    term_entry.log_document_freq = term_entry.document_count > 0 ? log(term_entry.document_count) : 0.0;
 }
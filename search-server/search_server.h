@@ -7,15 +7,50 @@
 #include <vector>
 #include <algorithm> 
 #include <numeric>
+#include <optional>
 #include <set>
 #include <string>
 #include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
 
 #include "document.h"
+#include "excluded_documents.h"
+#include "forward_index.h"
+#include "index_file.h"
+#include "index_segment.h"
+#include "left_right.h"
+#include "metrics.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
-const int kMaxDocumentCount = 5;
-const double kEps = 1e-6;
+#include "position_index.h"
+#include "posting_list.h"
+#include "query_cache.h"
+#include "score_accumulator.h"
+#include "term_dictionary.h"
+#include "text_arena.h"
+#include "top_documents.h"
+const size_t kMaxDocumentCount = 5;
+
+enum class QueryEvaluation {
+    EXHAUSTIVE, // every posting of every plus word is scored
+    MAX_SCORE,  // documents that cannot reach the top are skipped, results are the same
+};
+
+struct NewDocument {
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
+
+struct SearchPage {
+    std::vector<Document> documents;
+    // Resumes the search after the last document of the page, empty on the last page
+    std::string next_cursor;
+};
 
 class SearchServer {
 public:
@@ -27,77 +62,361 @@ public:
                  
     
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const vector<int>& ratings); 
+
+    // Adds all documents or none: if any of them would make AddDocument throw, the first such
+    // error in batch order is thrown and the index is left unchanged
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    void AddDocuments(const std::execution::sequenced_policy&, const std::vector<NewDocument>& documents);
+    void AddDocuments(const std::execution::parallel_policy&, const std::vector<NewDocument>& documents);
    
+    // A removed document is marked in the ordinal table and skipped by searches; its postings
+    // stay in the index until the segment holding them is merged. Policies are accepted for
+    // compatibility, marking does not touch posting lists.
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
+
+    // Unknown ids are ignored
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::execution::sequenced_policy&, const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::execution::parallel_policy&, const std::vector<int>& document_ids);
   
+    // A query word ending with * matches the indexed words with that prefix, *suffix and
+    // *infix* match by suffix and by substring. A plus wildcard stands for up to 64 matching
+    // words, those found in the most documents, each scored like a plus word.
      template <typename DocumentPredicate>
      std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const; 
     std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const; 
     std::vector<Document> FindTopDocuments(const std::string_view raw_query) const; 
     
+    // Overloads taking max_count return up to max_count documents instead of kMaxDocumentCount
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const; 
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status, size_t max_count) const; 
+    
     template <typename DocumentPredicate, typename Policy>
     std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const; 
+    template <typename DocumentPredicate, typename Policy>
+    std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const; 
 
     template <typename Policy>
     std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status) const; 
     template <typename Policy>
+    std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status, size_t max_count) const; 
+    template <typename Policy>
     std::vector<Document> FindTopDocuments(Policy& policy, const std::string_view raw_query) const; 
+
+    // Pages of results in result order, up to limit documents each. Only the documents of the
+    // page are selected: a page at an offset keeps the offset + limit best matches, a page
+    // after a cursor keeps the limit best ranked below the cursor's document, so deep pages
+    // cost no more than the first one. A cursor outlives document changes, but relevances may
+    // shift between the pages. Invalid cursors throw invalid_argument.
+    SearchPage FindTopDocumentsPage(const std::string_view raw_query, DocumentStatus status, size_t offset, size_t limit) const;
+    SearchPage FindNextDocumentsPage(const std::string_view raw_query, DocumentStatus status, const std::string& cursor, size_t limit) const;
+    template <typename DocumentPredicate, typename Policy>
+    SearchPage FindTopDocumentsPage(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate, size_t offset, size_t limit) const;
+    template <typename DocumentPredicate, typename Policy>
+    SearchPage FindNextDocumentsPage(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate, const std::string& cursor, size_t limit) const;
+    template <typename Policy>
+    SearchPage FindTopDocumentsPage(Policy& policy, const std::string_view raw_query, DocumentStatus status, size_t offset, size_t limit) const;
+    template <typename Policy>
+    SearchPage FindNextDocumentsPage(Policy& policy, const std::string_view raw_query, DocumentStatus status, const std::string& cursor, size_t limit) const;
           
     int GetDocumentCount() const; 
+
+    // Saves stop words, documents and the inverted index. Posting lists of a loaded server are
+    // read straight from the memory-mapped file until a merge rewrites their segment.
+    void SaveIndex(const std::string& path) const;
+    static SearchServer LoadIndex(const std::string& path);
+
+    void SetQueryEvaluation(QueryEvaluation query_evaluation);
+
+    // New postings go to an in-memory write buffer, which becomes an immutable index segment
+    // once it holds posting_count postings. Runs of segments of similar size are merged in the
+    // background into larger ones, leaving out the postings of removed documents.
+    void SetWriteBufferCapacity(size_t posting_count);
+    // Turns the write buffer and all segments into a single segment without removed documents
+    void CompactIndex();
+
+    // Lets searches run concurrently with document changes. The index is kept in two replicas:
+    // searches read the published one without waiting, changes are applied to the other one,
+    // published, and repeated on the old one once the searches using it have finished. Changes
+    // take twice as long and memory use doubles. Must be enabled before documents are added.
+    // References and iterators returned by the server stay valid until the next change.
+    void EnableConcurrentReads();
+
+    // Results of searches by status are cached until the next AddDocument or RemoveDocument.
+    // Capacity 0 turns the cache off.
+    void SetResultCacheCapacity(size_t capacity);
+    QueryResultCache::Stats GetResultCacheStats() const;
+
+    // Keeps the positions of words in documents, which phrase and proximity queries need:
+    // "quick brown fox" matches the words in this order next to each other, quick NEAR/3 fox
+    // matches the two words at most 3 positions apart in any order. Stop words count as
+    // positions. Positions of documents already added, or loaded from an index file, are
+    // built from their texts. Such queries throw invalid_argument while positions are off.
+    void EnablePositions();
  
-    const map<string_view, double>& GetWordFrequencies(int document_id) const; // new
+    // Built from the forward index on each call
+    map<string_view, double> GetWordFrequencies(int document_id) const; // new
+    // Term ids of the document's words in ascending order; equal words of two documents have
+    // equal ids. Empty for unknown documents.
+    vector<TermId> GetWordIds(int document_id) const;
     set<int>::const_iterator begin() const;//new lesson 12
     set<int>::const_iterator end() const;//new
     
     tuple<vector<string_view>, DocumentStatus> MatchDocument(const string_view raw_query, int document_id) const;
     tuple<vector<string_view>, DocumentStatus> MatchDocument(const execution::parallel_policy&, const string_view raw_query, int document_id) const;
     tuple<vector<string_view>, DocumentStatus> MatchDocument(const execution::sequenced_policy&, const string_view raw_query, int document_id) const ;
+
+    // Matches the documents against a query parsed once, results follow the order of the ids.
+    // Unknown documents get no words, like in MatchDocument.
+    vector<tuple<vector<string_view>, DocumentStatus>> MatchDocuments(const string_view raw_query, const vector<int>& document_ids) const;
+    vector<tuple<vector<string_view>, DocumentStatus>> MatchDocuments(const execution::sequenced_policy&, const string_view raw_query, const vector<int>& document_ids) const;
+    vector<tuple<vector<string_view>, DocumentStatus>> MatchDocuments(const execution::parallel_policy&, const string_view raw_query, const vector<int>& document_ids) const;
     
 private:
+    friend class BatchQueryEngine;
+
     
     struct DocumentData {
         int rating;
         DocumentStatus status;
-        string data;//s8
+        string_view data; // stored in document_texts_
+        int ordinal;
      //   map<std::string_view, double> word_to_freqs;//s8
     };
     
     const set<string, std::less<>> stop_words_;
-    map<string_view, map<int, double>> word_to_document_freqs_;
+    // Per-ordinal data read on every posting, kept dense for cache-friendly scans. Status and
+    // rating are copies of the document's, so filters need no document lookup.
+    struct OrdinalEntry {
+        int document_id;
+        DocumentStatus status;
+        double inv_word_count;
+        int rating;
+    };
+
+    // Filter of the searches by status. Scans recognize it at compile time and compare the
+    // status in the ordinal table instead of calling a predicate.
+    struct StatusPredicate {
+        DocumentStatus status;
+    };
+
+    template <typename DocumentPredicate>
+    static bool MatchesPredicate(const OrdinalEntry& entry, DocumentPredicate& document_predicate);
+
+    struct TermEntry {
+        // postings of the documents in the write buffer, older ones are in segments
+        PostingList buffered_postings;
+        // Upper bound of the term's frequency in a document. Removing documents may leave it
+        // higher than the actual maximum, which keeps it a valid bound.
+        double max_term_freq = 0.0;
+        // documents containing the term, not counting removed ones
+        int document_count = 0;
+        // log of document_count, updated whenever it changes. The IDF of the term is
+        // log(document count) - log_document_freq, so a change of the document count alone
+        // leaves every term's entry valid.
+        double log_document_freq = 0.0;
+    };
+
+    struct SegmentSlot {
+        std::shared_ptr<const IndexSegment> segment;
+        // removed documents of the segment's range; their postings are still in the segment
+        int removed_count = 0;
+    };
+
+    static constexpr std::string_view kNearOperator = "NEAR/";
+    // Plus wildcards are expanded into at most this many words, minus ones into all they match
+    static const size_t kMaxWildcardTerms = 64;
+    static const size_t kDefaultWriteBufferCapacity = 1 << 16;
+    static const size_t kSegmentMergeFactor = 4;
+
+    TermDictionary terms_;
+    vector<TermEntry> term_entries_; // indexed by TermId
+    vector<OrdinalEntry> ordinals_; // removed documents keep their entries, with document_id -1
+    // Segments cover adjacent ordinal ranges in ascending order, the write buffer covers the
+    // ordinals from buffer_begin_ordinal_ on
+    vector<SegmentSlot> segments_;
+    int buffer_begin_ordinal_ = 0;
+    size_t buffered_posting_count_ = 0;
+    int buffer_removed_count_ = 0;
+    size_t write_buffer_capacity_ = kDefaultWriteBufferCapacity;
+    // A merge running in the background, it replaces merge_slot_count_ segments starting at
+    // merge_first_slot_. Finished merges are installed by the next document change.
+    std::future<std::shared_ptr<const IndexSegment>> pending_merge_;
+    size_t merge_first_slot_ = 0;
+    size_t merge_slot_count_ = 0;
+    int merge_removed_count_ = 0;
     map<int, DocumentData> documents_;
+    TextArena document_texts_;
+    size_t live_text_bytes_ = 0;
     set<int> document_ids_;
-    map<int, map<string_view, double>> document_words_freqs_;//new 
+    ForwardIndex forward_index_; // by ordinal
+    std::unique_ptr<PositionIndex> positions_; // by ordinal, null while positions are off
+    QueryEvaluation query_evaluation_ = QueryEvaluation::EXHAUSTIVE;
+    // Changes on every AddDocument and RemoveDocument. Any change alters the IDF of all
+    // terms, so cached results of every query go stale together.
+    uint64_t generation_ = 0;
+    std::unique_ptr<QueryResultCache> result_cache_;
+    // Keeps the index file mapped while loaded postings and terms point into it
+    std::shared_ptr<const void> index_file_;
+    // Set when concurrent reads are enabled, the index members of this object then stay empty.
+    // The result cache is shared by the replicas, entries carry the replica's generation.
+    std::unique_ptr<LeftRight<SearchServer>> replicas_;
+
+    template <typename Change>
+    void ChangeReplicas(Change change);
   
     bool IsStopWord(const string_view word) const;
     
     static bool IsValidWord(const string_view word);
 
-    vector<string_view> SplitIntoWordsNoStop(const string_view text) const;
+    // Words are written into the caller's buffer, positions, if given, get the position of
+    // each word in the text counting stop words
+    void SplitIntoWordsNoStop(const string_view text, vector<string_view>& words, vector<uint32_t>* positions = nullptr) const;
+
+    // Pairs of the term and the position of each word, sorted; the words must be interned
+    vector<pair<TermId, uint32_t>> FindTermPositions(const vector<string_view>& words, const vector<uint32_t>& positions) const;
 
     static int ComputeAverageRating(const vector<int>& ratings); 
 
+    string_view StoreDocumentText(string_view text);
+    void ReleaseDocumentText(string_view text);
+
+    template <typename Policy>
+    void AddDocumentBatch(Policy& policy, const std::vector<NewDocument>& documents);
+    void RemoveDocumentBatch(const std::vector<int>& document_ids);
+    template <typename Policy>
+    vector<tuple<vector<string_view>, DocumentStatus>> MatchDocumentBatch(Policy& policy, const string_view raw_query, const vector<int>& document_ids) const;
+    void MarkDocumentRemoved(int document_id);
+
+    void SealWriteBuffer();
+    void ScheduleMerge();
+    void StartMerge(size_t first_slot, size_t slot_count);
+    // Without waiting, a merge that has not finished yet is left running
+    void InstallMerge(bool wait);
+    size_t FindSegmentSlot(int ordinal) const;
+
     struct QueryWord {
         string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(const string_view text) const; 
+    QueryWord ParseQueryWord(const string_view text, bool is_valid) const; 
+
+    // Non-stop words of a quoted phrase with their offsets from its first word
+    struct QueryPhrase {
+        vector<pair<string_view, int>> words;
+    };
+
+    struct QueryNear {
+        string_view lhs;
+        string_view rhs;
+        int max_distance;
+    };
 
+    // Words of phrases and NEAR operands are plus words as well
     struct Query {
         vector<string_view> plus_words;
         vector<string_view> minus_words;
+        vector<QueryPhrase> phrases; // of two words and more
+        vector<QueryNear> nears;
     };
      
     Query ParseQuery(const string_view text, bool sorting = false) const; 
-   
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const string_view word) const;
+    // Distance of a NEAR/k operator
+    static int ParseNearDistance(string_view word);
+    static bool IsWildcard(const string_view word);
+    // Appends the words matching a prefix*, *suffix or *infix* pattern. Capped expansions keep
+    // the kMaxWildcardTerms words found in the most documents.
+    void ExpandWildcard(string_view pattern, bool is_capped, vector<string_view>& words) const;
+
+    // Sorts the query words and returns a key that is equal for queries with the same results:
+    // the same plus words, counting repeats, the same minus words and the same phrases and
+    // NEAR operators in the same order
+    static string NormalizeQuery(Query& query);
+    static string MakeResultCacheKey(string query_key, DocumentStatus status, size_t max_count);
+
+    struct QueryTerm {
+        const TermEntry* entry;
+        double weight; // IDF times the number of the word's occurrences in the query
+    };
+
+    // Posting lists of the query words in one segment or in the write buffer
+    struct SegmentQuery {
+        int begin_ordinal;
+        int end_ordinal;
+        vector<const PostingList*> plus_postings; // by plus term, null where the term is absent
+        vector<const PostingList*> minus_postings;
+    };
+
+    // Phrases and NEAR operators with their words looked up, unknown words are kNoTerm
+    struct ProximityQuery {
+        vector<vector<pair<TermId, int>>> phrases; // terms with their offsets
+        struct Near {
+            TermId lhs;
+            TermId rhs;
+            int max_distance;
+        };
+        vector<Near> nears;
+
+        bool empty() const;
+        // false if a word is unknown, then no document matches
+        bool IsSatisfiable() const;
+    };
+
+    // Query words looked up in the index; words without documents are dropped
+    struct ResolvedQuery {
+        vector<QueryTerm> plus_terms; // ordered by term id
+        vector<SegmentQuery> segments; // in ordinal order, those without plus terms are left out
+        ProximityQuery proximity; // checked on each document that scores
+    };
+
+    ResolvedQuery ResolveQuery(const Query& query) const;
+    // Plus term ids may repeat, a repeated word weighs as many times as it occurs
+    ResolvedQuery ResolveQuery(vector<TermId> plus_term_ids, const vector<TermId>& minus_term_ids, ProximityQuery proximity = {}) const;
+    // Throws invalid_argument if the query has phrases or NEAR operators and positions are off
+    ProximityQuery ResolveProximity(const Query& query) const;
+    bool MatchesProximity(const ProximityQuery& proximity, int ordinal) const;
+    // Unknown words are dropped
+    vector<TermId> FindTermIds(const vector<string_view>& words) const;
+
+    const PostingList* FindBufferedPostings(TermId term_id) const;
+
+    static void UpdateDocumentFreq(TermEntry& term_entry);
+
+    template <typename Policy>
+    std::vector<Document> FindTopDocumentsByStatus(Policy& policy, const std::string_view raw_query, DocumentStatus status, size_t max_count, QueryResultCache* result_cache) const;
+
+    // Only documents ranked below after are selected
+    template <typename DocumentPredicate, typename Policy>
+    std::vector<Document> FindTopDocumentsResolved(Policy& policy, const ResolvedQuery& query, DocumentPredicate document_predicate, size_t max_count,
+        std::optional<Document> after = std::nullopt) const;
+
+    // documents holds the best matches up to offset + limit + 1; one beyond the page tells
+    // that a next page exists
+    static SearchPage MakeSearchPage(std::vector<Document> documents, size_t offset, size_t limit);
+    static std::string EncodeSearchCursor(const Document& document);
+    static Document DecodeSearchCursor(const std::string& cursor);
 
     template <typename DocumentPredicate, typename Policy>
-    std::vector<Document>  FindAllDocuments(Policy& policy, const Query& query, DocumentPredicate document_predicate) const; 
+    std::vector<Document>  FindAllDocuments(Policy& policy, const ResolvedQuery& query, DocumentPredicate document_predicate) const; 
+
+    template <typename DocumentPredicate, typename Policy, typename Accumulator>
+    void ScoreDocuments(Policy& policy, const ResolvedQuery& query, DocumentPredicate& document_predicate, Accumulator& accumulator) const;
+
+    template <typename Policy>
+    ExcludedDocuments FindExcludedDocuments(Policy& policy, const vector<const PostingList*>& minus_postings, int begin_ordinal, int end_ordinal) const;
+
+    template <typename DocumentPredicate, typename Policy>
+    std::vector<Document> FindTopDocumentsMaxScore(Policy& policy, const ResolvedQuery& query, DocumentPredicate& document_predicate, size_t max_count,
+        const std::optional<Document>& after) const;
+
+    template <typename DocumentPredicate>
+    void CollectTopDocumentsMaxScore(const ResolvedQuery& query, const SegmentQuery& segment, DocumentPredicate& document_predicate,
+        int begin_ordinal, int end_ordinal, TopDocuments& top) const;
     
     };
     
@@ -116,68 +435,351 @@ vector<Document>SearchServer::FindTopDocuments(const std::string_view raw_query,
     return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
 }
 
+template <typename DocumentPredicate>
+vector<Document>SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_count);
+}
+
 template <typename DocumentPredicate, typename Policy>
 vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-    std::sort(policy,
-        matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-        return (std::abs(lhs.relevance - rhs.relevance) < kEps && lhs.rating > rhs.rating)
-            || (lhs.relevance > rhs.relevance);
-    });
-    if (matched_documents.size() > kMaxDocumentCount) {
-        matched_documents.resize(kMaxDocumentCount);
+    return FindTopDocuments(policy, raw_query, document_predicate, kMaxDocumentCount);
+}
+
+template <typename DocumentPredicate, typename Policy>
+vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const {
+    if (replicas_) {
+        return replicas_->Read([&](const SearchServer& replica) {
+            return replica.FindTopDocuments(policy, raw_query, document_predicate, max_count);
+        });
     }
-    return matched_documents;
+    return FindTopDocumentsResolved(policy, ResolveQuery(ParseQuery(raw_query)), document_predicate, max_count);
 }
 
 template <typename Policy>
 vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query, [status](int, DocumentStatus document_status, int) {
-        return document_status == status;
-    });
+    return FindTopDocuments(policy, raw_query, status, kMaxDocumentCount);
+}
+
+template <typename Policy>
+vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status, size_t max_count) const {
+    if (replicas_) {
+        return replicas_->Read([&](const SearchServer& replica) {
+            return replica.FindTopDocumentsByStatus(policy, raw_query, status, max_count, result_cache_.get());
+        });
+    }
+    return FindTopDocumentsByStatus(policy, raw_query, status, max_count, result_cache_.get());
+}
+
+template <typename Policy>
+vector<Document> SearchServer::FindTopDocumentsByStatus(Policy& policy, const std::string_view raw_query, DocumentStatus status, size_t max_count, QueryResultCache* result_cache) const {
+    const StatusPredicate document_predicate{status};
+    if (!result_cache) {
+        return FindTopDocuments(policy, raw_query, document_predicate, max_count);
+    }
+    Query query = ParseQuery(raw_query);
+    std::string key = MakeResultCacheKey(NormalizeQuery(query), status, max_count);
+    if (auto documents = result_cache->Find(key, generation_)) {
+        return std::move(*documents);
+    }
+    auto documents = FindTopDocumentsResolved(policy, ResolveQuery(query), document_predicate, max_count);
+    result_cache->Insert(std::move(key), generation_, documents);
+    return documents;
 }
 
 template <typename Policy>
 vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query) const {
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
+
+template <typename DocumentPredicate, typename Policy>
+SearchPage SearchServer::FindTopDocumentsPage(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate, size_t offset, size_t limit) const {
+    return MakeSearchPage(FindTopDocuments(policy, raw_query, document_predicate, offset + limit + 1), offset, limit);
+}
+
+template <typename DocumentPredicate, typename Policy>
+SearchPage SearchServer::FindNextDocumentsPage(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate, const std::string& cursor, size_t limit) const {
+    if (replicas_) {
+        return replicas_->Read([&](const SearchServer& replica) {
+            return replica.FindNextDocumentsPage(policy, raw_query, document_predicate, cursor, limit);
+        });
+    }
+    const Document after = DecodeSearchCursor(cursor);
+    return MakeSearchPage(FindTopDocumentsResolved(policy, ResolveQuery(ParseQuery(raw_query)), document_predicate, limit + 1, after), 0, limit);
+}
+
+template <typename Policy>
+SearchPage SearchServer::FindTopDocumentsPage(Policy& policy, const std::string_view raw_query, DocumentStatus status, size_t offset, size_t limit) const {
+    // goes through the result cache like any search by status
+    return MakeSearchPage(FindTopDocuments(policy, raw_query, status, offset + limit + 1), offset, limit);
+}
+
+template <typename Policy>
+SearchPage SearchServer::FindNextDocumentsPage(Policy& policy, const std::string_view raw_query, DocumentStatus status, const std::string& cursor, size_t limit) const {
+    return FindNextDocumentsPage(policy, raw_query, StatusPredicate{status}, cursor, limit);
+}
       
 template <typename DocumentPredicate, typename Policy>
-std::vector<Document> SearchServer::FindAllDocuments(Policy& policy, const SearchServer::Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(50);
-    std::for_each(policy,
-        query.plus_words.begin(), query.plus_words.end(),
-        [this, &document_to_relevance, &document_predicate, &policy] (const std::string_view word) {
-            if (word_to_document_freqs_.count(word) > 0) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                std::for_each(policy,
-                    word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                    [this, &document_to_relevance, &document_predicate, &inverse_document_freq] (const auto& pair) {
-                        const auto& document_data = documents_.at(pair.first);
-                        if (document_predicate(pair.first, document_data.status, document_data.rating)) {
-                            document_to_relevance[pair.first].ref_to_value += pair.second * inverse_document_freq;
-                        }
+std::vector<Document> SearchServer::FindTopDocumentsResolved(Policy& policy, const ResolvedQuery& query, DocumentPredicate document_predicate, size_t max_count,
+    std::optional<Document> after) const {
+    MetricsRegistry::GetInstance().Add(MetricCounter::QUERIES_EVALUATED);
+    if (query_evaluation_ == QueryEvaluation::MAX_SCORE) {
+        return FindTopDocumentsMaxScore(policy, query, document_predicate, max_count, after);
+    }
+    const auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+    MetricsRegistry::GetInstance().Add(MetricCounter::DOCUMENTS_SCORED, matched_documents.size());
+    TIME_STAGE(MetricStage::TOP_K_SELECTION);
+    return SelectTopDocuments(policy, matched_documents, max_count, after);
+}
+
+template <typename DocumentPredicate>
+bool SearchServer::MatchesPredicate(const OrdinalEntry& entry, DocumentPredicate& document_predicate) {
+    if constexpr (std::is_same_v<std::decay_t<DocumentPredicate>, StatusPredicate>) {
+        return entry.status == document_predicate.status;
+    } else {
+        return document_predicate(entry.document_id, entry.status, entry.rating);
+    }
+}
+
+template <typename DocumentPredicate, typename Policy>
+std::vector<Document> SearchServer::FindAllDocuments(Policy& policy, const SearchServer::ResolvedQuery& query, DocumentPredicate document_predicate) const {
+    std::vector<Document> matched_documents;
+    if constexpr (std::is_same_v<std::decay_t<Policy>, std::execution::parallel_policy>) {
+        const auto accumulator_handle = ConcurrentScoreAccumulator::Acquire();
+        auto& accumulator = *accumulator_handle;
+        accumulator.Reset(ordinals_.size());
+        ScoreDocuments(policy, query, document_predicate, accumulator);
+        const size_t touched_count = accumulator.GetTouchedCount();
+        const size_t chunk_count = std::max(1u, std::thread::hardware_concurrency());
+        const size_t chunk_size = (touched_count + chunk_count - 1) / chunk_count;
+        std::vector<std::vector<Document>> chunk_documents(chunk_count);
+        std::vector<size_t> chunk_indexes(chunk_count);
+        std::iota(chunk_indexes.begin(), chunk_indexes.end(), 0);
+        std::for_each(policy,
+            chunk_indexes.begin(), chunk_indexes.end(),
+            [this, &query, &accumulator, &chunk_documents, touched_count, chunk_size] (size_t chunk_index) {
+                const size_t begin = std::min(touched_count, chunk_index * chunk_size);
+                const size_t end = std::min(touched_count, begin + chunk_size);
+                accumulator.ForEachScored(begin, end, [this, &query, &documents = chunk_documents[chunk_index]] (int ordinal, double relevance) {
+                    if (!MatchesProximity(query.proximity, ordinal)) {
+                        return;
+                    }
+                    const OrdinalEntry& entry = ordinals_[ordinal];
+                    documents.push_back({entry.document_id, relevance, entry.rating});
                 });
+            });
+        for (const auto& documents : chunk_documents) {
+            matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+        }
+    } else {
+        auto& accumulator = ScoreAccumulator::GetThreadInstance();
+        accumulator.Reset(ordinals_.size());
+        ScoreDocuments(policy, query, document_predicate, accumulator);
+        accumulator.ForEachScored([this, &query, &matched_documents] (int ordinal, double relevance) {
+            if (!MatchesProximity(query.proximity, ordinal)) {
+                return;
             }
+            const OrdinalEntry& entry = ordinals_[ordinal];
+            matched_documents.push_back({entry.document_id, relevance, entry.rating});
         });
-    std::for_each(policy,
-        query.minus_words.begin(), query.minus_words.end(),
-        [this, &document_to_relevance, &policy] (const std::string_view word) {
-            if (word_to_document_freqs_.count(word) > 0) {
-                std::for_each(policy,
-                    word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                    [&document_to_relevance] (const auto& pair) {
-                        document_to_relevance.Erase(pair.first);
-                });
+    }
+    return matched_documents;
+}
+
+template <typename DocumentPredicate, typename Policy, typename Accumulator>
+void SearchServer::ScoreDocuments(Policy& policy, const ResolvedQuery& query, DocumentPredicate& document_predicate, Accumulator& accumulator) const {
+    std::vector<const PostingList*> minus_postings;
+    for (const SegmentQuery& segment : query.segments) {
+        minus_postings.insert(minus_postings.end(), segment.minus_postings.begin(), segment.minus_postings.end());
+    }
+    const ExcludedDocuments excluded = FindExcludedDocuments(policy, minus_postings, 0, static_cast<int>(ordinals_.size()));
+    TIME_STAGE(MetricStage::POSTING_SCAN);
+    // every list of every segment is scanned on its own, a document's postings all lie in one segment
+    std::vector<std::pair<const PostingList*, double>> weighted_postings;
+    size_t posting_count = 0;
+    for (const SegmentQuery& segment : query.segments) {
+        for (size_t i = 0; i < segment.plus_postings.size(); ++i) {
+            if (segment.plus_postings[i] != nullptr) {
+                weighted_postings.emplace_back(segment.plus_postings[i], query.plus_terms[i].weight);
+                posting_count += segment.plus_postings[i]->size();
             }
+        }
+    }
+    MetricsRegistry::GetInstance().Add(MetricCounter::POSTINGS_SCANNED, posting_count);
+    std::for_each(policy,
+        weighted_postings.begin(), weighted_postings.end(),
+        [this, &accumulator, &document_predicate, &excluded, &policy] (const std::pair<const PostingList*, double>& term_postings) {
+            const PostingList& postings = *term_postings.first;
+            const double weight = term_postings.second;
+            std::vector<size_t> block_indexes(postings.GetBlockCount());
+            std::iota(block_indexes.begin(), block_indexes.end(), 0);
+            std::for_each(policy,
+                block_indexes.begin(), block_indexes.end(),
+                [this, &postings, &accumulator, &document_predicate, &excluded, weight] (size_t block_index) {
+                    PostingList::DecodedBlock block;
+                    postings.DecodeBlock(block_index, block);
+                    for (size_t i = 0; i < block.size; ++i) {
+                        if (excluded.Contains(block.ordinals[i])) {
+                            continue;
+                        }
+                        const OrdinalEntry& entry = ordinals_[block.ordinals[i]];
+                        if (entry.document_id >= 0 && MatchesPredicate(entry, document_predicate)) {
+                            const double term_freq = block.word_counts[i] * entry.inv_word_count;
+                            accumulator.Add(block.ordinals[i], term_freq * weight);
+                        }
+                    }
+            });
         });
-     
-    std::map<int, double> doc_to_relevance = document_to_relevance.BuildOrdinaryMap();
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : doc_to_relevance) { 
-        matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating}); 
-    } 
-    return matched_documents;
-}
\ No newline at end of file
+}
+
+// Minus words are resolved into excluded ordinals before scoring, so excluded documents
+// are never scored or gathered
+template <typename Policy>
+ExcludedDocuments SearchServer::FindExcludedDocuments(Policy& policy, const vector<const PostingList*>& minus_postings, int begin_ordinal, int end_ordinal) const {
+    TIME_STAGE(MetricStage::MINUS_WORD_FILTER);
+    return ExcludedDocuments(policy, minus_postings, begin_ordinal, end_ordinal);
+}
+
+template <typename DocumentPredicate, typename Policy>
+std::vector<Document> SearchServer::FindTopDocumentsMaxScore(Policy& policy, const ResolvedQuery& query, DocumentPredicate& document_predicate, size_t max_count,
+    const std::optional<Document>& after) const {
+    // pruning compares with the worst document of a full top, an empty top has none
+    if (max_count == 0) {
+        return {};
+    }
+    // scanning and top selection are interleaved, the whole evaluation counts as the scan
+    TIME_STAGE(MetricStage::POSTING_SCAN);
+    const int ordinal_count = static_cast<int>(ordinals_.size());
+    if constexpr (std::is_same_v<std::decay_t<Policy>, std::execution::parallel_policy>) {
+        // ordinal ranges are evaluated independently, the global top is among the per-range tops
+        const int chunk_count = std::max(1u, std::thread::hardware_concurrency());
+        const int chunk_size = (ordinal_count + chunk_count - 1) / chunk_count;
+        std::vector<int> chunk_indexes(chunk_count);
+        std::iota(chunk_indexes.begin(), chunk_indexes.end(), 0);
+        std::vector<TopDocuments> chunk_tops(chunk_count, TopDocuments(max_count, after));
+        std::for_each(policy,
+            chunk_indexes.begin(), chunk_indexes.end(),
+            [this, &query, &document_predicate, &chunk_tops, ordinal_count, chunk_size] (int chunk_index) {
+                const int begin_ordinal = std::min(ordinal_count, chunk_index * chunk_size);
+                const int end_ordinal = std::min(ordinal_count, begin_ordinal + chunk_size);
+                for (const SegmentQuery& segment : query.segments) {
+                    const int begin = std::max(begin_ordinal, segment.begin_ordinal);
+                    const int end = std::min(end_ordinal, segment.end_ordinal);
+                    if (begin < end) {
+                        CollectTopDocumentsMaxScore(query, segment, document_predicate, begin, end, chunk_tops[chunk_index]);
+                    }
+                }
+            });
+        TopDocuments top(max_count, after);
+        for (const TopDocuments& chunk_top : chunk_tops) {
+            top.Merge(chunk_top);
+        }
+        return std::move(top).Extract();
+    } else {
+        // the top carries over from segment to segment, so later segments skip more
+        TopDocuments top(max_count, after);
+        for (const SegmentQuery& segment : query.segments) {
+            CollectTopDocumentsMaxScore(query, segment, document_predicate, segment.begin_ordinal, segment.end_ordinal, top);
+        }
+        return std::move(top).Extract();
+    }
+}
+
+// MaxScore: terms are ordered by the upper bound of their contribution. Once the top is full,
+// the longest prefix of terms whose bounds together cannot beat its worst document is
+// "non-essential": only documents containing an essential term are visited, and non-essential
+// lists are probed by skipping, while the document still has a chance to enter the top.
+template <typename DocumentPredicate>
+void SearchServer::CollectTopDocumentsMaxScore(const ResolvedQuery& query, const SegmentQuery& segment, DocumentPredicate& document_predicate,
+    int begin_ordinal, int end_ordinal, TopDocuments& top) const {
+    // terms absent from the segment take no part
+    std::vector<size_t> term_order;
+    std::vector<double> upper_bounds(query.plus_terms.size());
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        if (segment.plus_postings[i] != nullptr) {
+            term_order.push_back(i);
+            upper_bounds[i] = query.plus_terms[i].entry->max_term_freq * query.plus_terms[i].weight;
+        }
+    }
+    const size_t term_count = term_order.size();
+    std::sort(term_order.begin(), term_order.end(), [&upper_bounds] (size_t lhs, size_t rhs) {
+        return upper_bounds[lhs] < upper_bounds[rhs];
+    });
+    // bound_prefix[i] is the total bound of the i terms with the smallest bounds
+    std::vector<double> bound_prefix(term_count + 1, 0.0);
+    std::vector<PostingList::Cursor> cursors;
+    cursors.reserve(term_count);
+    for (size_t i = 0; i < term_count; ++i) {
+        bound_prefix[i + 1] = bound_prefix[i] + upper_bounds[term_order[i]];
+        cursors.push_back(segment.plus_postings[term_order[i]]->GetCursor());
+        cursors.back().SkipTo(begin_ordinal);
+    }
+    const ExcludedDocuments excluded = FindExcludedDocuments(std::execution::seq, segment.minus_postings, begin_ordinal, end_ordinal);
+
+    // contributions are summed in term id order, exactly as exhaustive scoring adds them
+    std::vector<double> contributions(query.plus_terms.size(), 0.0);
+    const auto add_contribution = [this, &query, &term_order, &contributions] (size_t i, const Posting& posting) {
+        const size_t term_index = term_order[i];
+        const double term_freq = posting.word_count * ordinals_[posting.document_ordinal].inv_word_count;
+        contributions[term_index] = term_freq * query.plus_terms[term_index].weight;
+        return contributions[term_index];
+    };
+
+    uint64_t posting_count = 0;
+    uint64_t document_count = 0;
+    size_t first_essential = 0;
+    while (true) {
+        // a document has to score above this to enter the top; the margin covers rounding of bounds
+        const double threshold = top.IsFull()
+            ? top.GetWorst().relevance - 2 * kEps
+            : -std::numeric_limits<double>::infinity();
+        while (first_essential < term_count && bound_prefix[first_essential + 1] < threshold) {
+            ++first_essential;
+        }
+        if (first_essential == term_count) {
+            break;
+        }
+        int ordinal = end_ordinal;
+        for (size_t i = first_essential; i < term_count; ++i) {
+            if (!cursors[i].IsEnd()) {
+                ordinal = std::min(ordinal, cursors[i]->document_ordinal);
+            }
+        }
+        if (ordinal >= end_ordinal) {
+            break;
+        }
+
+        double score = 0.0;
+        for (size_t i = first_essential; i < term_count; ++i) {
+            if (!cursors[i].IsEnd() && cursors[i]->document_ordinal == ordinal) {
+                score += add_contribution(i, *cursors[i]);
+                ++posting_count;
+                cursors[i].Next();
+            }
+        }
+        // postings of removed documents stay in the segment until it is merged. The filter is
+        // applied before the non-essential lists are probed.
+        const OrdinalEntry& entry = ordinals_[ordinal];
+        bool is_candidate = entry.document_id >= 0
+            && score + bound_prefix[first_essential] >= threshold && !excluded.Contains(ordinal)
+            && MatchesPredicate(entry, document_predicate);
+        for (size_t i = first_essential; is_candidate && i-- > 0;) {
+            cursors[i].SkipTo(ordinal);
+            if (!cursors[i].IsEnd() && cursors[i]->document_ordinal == ordinal) {
+                score += add_contribution(i, *cursors[i]);
+                ++posting_count;
+            }
+            is_candidate = score + bound_prefix[i] >= threshold;
+        }
+        ++document_count;
+        if (is_candidate && MatchesProximity(query.proximity, ordinal)) {
+            double relevance = 0.0;
+            for (const double contribution : contributions) {
+                relevance += contribution;
+            }
+            top.Push({entry.document_id, relevance, entry.rating});
+        }
+        std::fill(contributions.begin(), contributions.end(), 0.0);
+    }
+    MetricsRegistry::GetInstance().Add(MetricCounter::POSTINGS_SCANNED, posting_count);
+    MetricsRegistry::GetInstance().Add(MetricCounter::DOCUMENTS_SCORED, document_count);
+}
@@ -1,18 +1,94 @@
 #include "string_processing.h"
 
+#include <algorithm>
 
-std::vector<std::string_view> SplitIntoWords(std::string_view text) {
-    std::vector<std::string_view> result;
-    const int64_t pos_end = text.npos;
-    while (true) {
-        int64_t space = text.find(' ');
-        result.push_back(space == pos_end ? text.substr(0) : text.substr(0, space));
-        if (space == pos_end) {
-            break;
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace {
+
+bool IsControlByte(char c) {
+    return static_cast<unsigned char>(c) < ' ';
+}
+
+#ifdef __SSE2__
+// Cuts a word at every set bit of space_mask, bit i standing for data[offset + i]
+void AddWordsBySpaceMask(const char* data, size_t offset, uint32_t space_mask, size_t& word_begin, std::vector<std::string_view>& words) {
+    while (space_mask != 0) {
+        const size_t space = offset + __builtin_ctz(space_mask);
+        words.emplace_back(data + word_begin, space - word_begin);
+        word_begin = space + 1;
+        space_mask &= space_mask - 1;
+    }
+}
+#endif
+
+} // namespace
+
+size_t SplitIntoWords(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    const char* const data = text.data();
+    const size_t size = text.size();
+    size_t word_begin = 0;
+    size_t first_control = size;
+    size_t i = 0;
+#ifdef __AVX2__
+    {
+        const __m256i spaces = _mm256_set1_epi8(' ');
+        const __m256i max_control = _mm256_set1_epi8(' ' - 1);
+        for (; i + 32 <= size; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            if (first_control == size) {
+                // unsigned bytes not above 0x1F are the ones equal to their minimum with 0x1F
+                const uint32_t control_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, max_control), bytes));
+                if (control_mask != 0) {
+                    first_control = i + __builtin_ctz(control_mask);
+                }
+            }
+            AddWordsBySpaceMask(data, i, _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, spaces)), word_begin, words);
         }
-        else {
-            text.remove_prefix(space + 1);
+    }
+#endif
+#ifdef __SSE2__
+    {
+        const __m128i spaces = _mm_set1_epi8(' ');
+        const __m128i max_control = _mm_set1_epi8(' ' - 1);
+        for (; i + 16 <= size; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            if (first_control == size) {
+                const uint32_t control_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(bytes, max_control), bytes));
+                if (control_mask != 0) {
+                    first_control = i + __builtin_ctz(control_mask);
+                }
+            }
+            AddWordsBySpaceMask(data, i, _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, spaces)), word_begin, words);
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        if (data[i] == ' ') {
+            words.emplace_back(data + word_begin, i - word_begin);
+            word_begin = i + 1;
+        } else if (first_control == size && IsControlByte(data[i])) {
+            first_control = i;
         }
     }
-    return result;
+    words.emplace_back(data + word_begin, size - word_begin);
+
+    if (first_control == size) {
+        return words.size();
+    }
+    // the control byte belongs to the last word starting at or before it
+    const auto it = std::upper_bound(words.begin(), words.end(), data + first_control,
+        [](const char* position, std::string_view word) {
+            return position < word.data();
+        });
+    return it - words.begin() - 1;
+}
+
+std::vector<std::string_view> SplitIntoWords(std::string_view text) {
+    std::vector<std::string_view> words;
+    SplitIntoWords(text, words);
+    return words;
 }
@@ -1,11 +1,18 @@
 #pragma once
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
+// Consecutive, leading and trailing spaces produce empty words
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
+// Splits text and looks for control characters (bytes below 0x20) in one vectorized pass.
+// The words are written into `words`, which is cleared first, so one buffer can serve many
+// calls. Returns the index of the first word with a control character, or words.size().
+size_t SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
@@ -0,0 +1,59 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+
+using namespace std;
+
+TermId TermDictionary::Intern(string_view term) {
+    if (const auto it = term_to_id_.find(term); it != term_to_id_.end()) {
+        return it->second;
+    }
+    return InternView(owned_terms_.Store(term));
+}
+
+TermId TermDictionary::InternView(string_view term) {
+    const auto [it, inserted] = term_to_id_.emplace(term, static_cast<TermId>(terms_.size()));
+    if (inserted) {
+        terms_.push_back(term);
+        AddSorted(it->second);
+    }
+    return it->second;
+}
+
+void TermDictionary::AddSorted(TermId term_id) {
+    const auto by_term = [this](TermId lhs, TermId rhs) {
+        return terms_[lhs] < terms_[rhs];
+    };
+    recent_ids_.insert(upper_bound(recent_ids_.begin(), recent_ids_.end(), term_id, by_term), term_id);
+    if (recent_ids_.size() < kRecentCapacity) {
+        return;
+    }
+    const size_t middle = sorted_ids_.size();
+    sorted_ids_.insert(sorted_ids_.end(), recent_ids_.begin(), recent_ids_.end());
+    inplace_merge(sorted_ids_.begin(), sorted_ids_.begin() + middle, sorted_ids_.end(), by_term);
+    recent_ids_.clear();
+}
+
+TermId TermDictionary::Find(string_view term) const {
+    const auto it = term_to_id_.find(term);
+    return it == term_to_id_.end() ? kNoTerm : it->second;
+}
+
+string_view TermDictionary::GetTerm(TermId term_id) const {
+    return terms_[term_id];
+}
+
+void TermDictionary::FindByPrefix(string_view prefix, vector<TermId>& term_ids) const {
+    for (const vector<TermId>* run : {&sorted_ids_, &recent_ids_}) {
+        auto it = lower_bound(run->begin(), run->end(), prefix, [this](TermId term_id, string_view prefix) {
+            return terms_[term_id] < prefix;
+        });
+        for (; it != run->end() && terms_[*it].substr(0, prefix.size()) == prefix; ++it) {
+            term_ids.push_back(*it);
+        }
+    }
+}
+
+size_t TermDictionary::size() const {
+    return terms_.size();
+}
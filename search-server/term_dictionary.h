@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "text_arena.h"
+
+using TermId = int;
+const TermId kNoTerm = -1;
+
+// Interns index terms into dense integer ids.
+// Term strings are owned by the dictionary, so views returned by GetTerm stay valid
+// for the dictionary's lifetime regardless of which documents are removed.
+// Ids are also kept in term order for prefix lookups: new terms go to a short sorted run,
+// which is merged into the main run once it fills up.
+class TermDictionary {
+public:
+    TermId Intern(std::string_view term);
+    // Like Intern, but keeps a view instead of a copy; the characters must outlive the dictionary
+    TermId InternView(std::string_view term);
+
+    // Returns kNoTerm for words that never were indexed
+    TermId Find(std::string_view term) const;
+
+    std::string_view GetTerm(TermId term_id) const;
+
+    // Appends the ids of the terms starting with prefix, in no particular order
+    void FindByPrefix(std::string_view prefix, std::vector<TermId>& term_ids) const;
+
+    size_t size() const;
+
+private:
+    TextArena                                       owned_terms_;
+    std::vector<std::string_view>                   terms_;
+    std::unordered_map<std::string_view, TermId>    term_to_id_;
+    std::vector<TermId>                             sorted_ids_; // by term
+    std::vector<TermId>                             recent_ids_; // by term, the newest terms
+
+    static const size_t kRecentCapacity = 4096;
+
+    void AddSorted(TermId term_id);
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "document.h"
+#include "remove_duplicates.h"
 #include "search_server.h"
 
 void PrintDocument(const Document& document);
@@ -8,5 +9,3 @@ void AddDocument(SearchServer& search_server, int document_id, std::string docum
     const std::vector<int>& ratings);
 void FindTopDocuments(const SearchServer& search_server, std::string raw_query);
 void MatchDocuments(const SearchServer& search_server, std::string query);
-
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "text_arena.h"
+
+#include <cstring>
+
+using namespace std;
+
+string_view TextArena::Store(string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    char* destination;
+    if (text.size() > kChunkSize / 4) {
+        // large texts get chunks of their own, so the free space of the current chunk is kept
+        chunks_.push_back(make_unique<char[]>(text.size()));
+        allocated_bytes_ += text.size();
+        destination = chunks_.back().get();
+    } else {
+        if (text.size() > free_size_) {
+            chunks_.push_back(make_unique<char[]>(kChunkSize));
+            allocated_bytes_ += kChunkSize;
+            free_space_ = chunks_.back().get();
+            free_size_ = kChunkSize;
+        }
+        destination = free_space_;
+        free_space_ += text.size();
+        free_size_ -= text.size();
+    }
+    memcpy(destination, text.data(), text.size());
+    stored_bytes_ += text.size();
+    return {destination, text.size()};
+}
+
+size_t TextArena::GetStoredBytes() const {
+    return stored_bytes_;
+}
+
+size_t TextArena::GetMemoryUsage() const {
+    return sizeof(TextArena) + chunks_.capacity() * sizeof(chunks_[0]) + allocated_bytes_;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only storage of strings in large chunks. Stored strings never move, so views into
+// the arena stay valid until the arena itself is destroyed. Space is never reused: to drop
+// strings that are no longer needed, the live ones are copied into a fresh arena.
+class TextArena {
+public:
+    static const size_t kChunkSize = 64 * 1024;
+
+    std::string_view Store(std::string_view text);
+
+    // Bytes of all strings ever stored
+    size_t GetStoredBytes() const;
+    size_t GetMemoryUsage() const;
+
+private:
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* free_space_ = nullptr;
+    size_t free_size_ = 0;
+    size_t stored_bytes_ = 0;
+    size_t allocated_bytes_ = 0;
+};
@@ -0,0 +1,97 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+namespace {
+
+// Index of the pool worker running on this thread, external threads have none
+thread_local size_t current_worker_index = SIZE_MAX;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    thread_count = max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; ++i) {
+        queues_.push_back(make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard guard(wake_mutex_);
+        is_stopping_ = true;
+    }
+    wake_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::GetShared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return workers_.size();
+}
+
+void ThreadPool::Push(function<void()> task) {
+    // workers keep their own tasks local, other threads spread them round robin
+    const size_t queue_index = current_worker_index < queues_.size()
+        ? current_worker_index
+        : next_queue_.fetch_add(1, memory_order_relaxed) % queues_.size();
+    {
+        lock_guard guard(queues_[queue_index]->mutex);
+        queues_[queue_index]->tasks.push_front(move(task));
+    }
+    {
+        lock_guard guard(wake_mutex_);
+        queued_count_.fetch_add(1, memory_order_release);
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::TryRunTask() {
+    const size_t home = current_worker_index < queues_.size() ? current_worker_index : 0;
+    for (size_t offset = 0; offset < queues_.size(); ++offset) {
+        WorkerQueue& queue = *queues_[(home + offset) % queues_.size()];
+        function<void()> task;
+        {
+            lock_guard guard(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (offset == 0) {
+                task = move(queue.tasks.front());
+                queue.tasks.pop_front();
+            } else {
+                task = move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            queued_count_.fetch_sub(1, memory_order_relaxed);
+        }
+        task();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t worker_index) {
+    current_worker_index = worker_index;
+    while (true) {
+        if (TryRunTask()) {
+            continue;
+        }
+        unique_lock lock(wake_mutex_);
+        wake_.wait(lock, [this] {
+            return is_stopping_ || queued_count_.load(memory_order_acquire) > 0;
+        });
+        if (is_stopping_) {
+            return;
+        }
+    }
+}
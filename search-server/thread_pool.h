@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with a task deque each. A worker takes tasks from the front
+// of its own deque and, when it runs dry, steals from the back of the others' deques.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Pool shared by the whole process, started on first use
+    static ThreadPool& GetShared();
+
+    size_t GetThreadCount() const;
+
+    // Runs function(index) for every index in [0, count) and waits for all of them.
+    // The calling thread runs tasks too, so nested calls from a worker do not deadlock.
+    // The first exception thrown by a call is rethrown here.
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> queued_count_ = 0;
+    std::atomic<size_t> next_queue_ = 0;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool is_stopping_ = false;
+
+    void Push(std::function<void()> task);
+    bool TryRunTask();
+    void WorkerLoop(size_t worker_index);
+};
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function) {
+    if (count == 0) {
+        return;
+    }
+    // a few chunks per thread keep the load balanced without a task per index
+    const size_t chunk_count = std::min(count, 4 * (workers_.size() + 1));
+    const size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+    std::atomic<size_t> remaining = chunk_count;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        Push([&, chunk] {
+            try {
+                const size_t end = std::min(count, (chunk + 1) * chunk_size);
+                for (size_t index = chunk * chunk_size; index < end; ++index) {
+                    function(index);
+                }
+            } catch (...) {
+                std::lock_guard guard(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        });
+    }
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!TryRunTask()) {
+            std::this_thread::yield();
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,53 @@
+#include "top_documents.h"
+
+#include <cmath>
+
+using namespace std;
+
+bool IsBetterDocument(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < kEps) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+TopDocuments::TopDocuments(size_t max_count, optional<Document> after)
+    : max_count_(max_count)
+    , after_(after) {
+}
+
+void TopDocuments::Push(const Document& document) {
+    if (after_ && !IsBetterDocument(*after_, document)) {
+        return;
+    }
+    if (heap_.size() < max_count_) {
+        heap_.push_back(document);
+        push_heap(heap_.begin(), heap_.end(), IsBetterDocument);
+    } else if (max_count_ > 0 && IsBetterDocument(document, heap_.front())) {
+        pop_heap(heap_.begin(), heap_.end(), IsBetterDocument);
+        heap_.back() = document;
+        push_heap(heap_.begin(), heap_.end(), IsBetterDocument);
+    }
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Push(document);
+    }
+}
+
+bool TopDocuments::IsFull() const {
+    return heap_.size() == max_count_;
+}
+
+const Document& TopDocuments::GetWorst() const {
+    return heap_.front();
+}
+
+vector<Document> TopDocuments::Extract() && {
+    sort_heap(heap_.begin(), heap_.end(), IsBetterDocument);
+    return move(heap_);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "document.h"
+
+const double kEps = 1e-6;
+
+// Search result order: higher relevance first; relevances closer than kEps are ordered
+// by rating, and complete ties by id so that the order does not depend on scan order
+bool IsBetterDocument(const Document& lhs, const Document& rhs);
+
+// Keeps the max_count best documents pushed into it in a bounded heap. With after given, only
+// documents ranked below it are kept, which selects a page that follows it.
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count, std::optional<Document> after = std::nullopt);
+
+    void Push(const Document& document);
+    void Merge(const TopDocuments& other);
+
+    bool IsFull() const;
+    // The document that will be evicted next, requires a non-empty selection
+    const Document& GetWorst() const;
+
+    // Returns the selected documents in result order
+    std::vector<Document> Extract() &&;
+
+private:
+    size_t max_count_;
+    std::optional<Document> after_;
+    // heap with the worst selected document on top
+    std::vector<Document> heap_;
+};
+
+// Selects the max_count best documents ranked below after; the parallel version keeps a heap
+// per chunk of input and merges them afterwards
+template <typename Policy>
+std::vector<Document> SelectTopDocuments(Policy&, const std::vector<Document>& documents, size_t max_count,
+    std::optional<Document> after = std::nullopt) {
+    if constexpr (std::is_same_v<std::decay_t<Policy>, std::execution::parallel_policy>) {
+        const size_t chunk_count = std::max(1u, std::thread::hardware_concurrency());
+        const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+        std::vector<size_t> chunk_indexes(chunk_count);
+        std::iota(chunk_indexes.begin(), chunk_indexes.end(), 0);
+        std::vector<TopDocuments> chunk_tops(chunk_count, TopDocuments(max_count, after));
+        std::for_each(std::execution::par,
+            chunk_indexes.begin(), chunk_indexes.end(),
+            [&documents, &chunk_tops, chunk_size] (size_t chunk_index) {
+                const size_t begin = std::min(documents.size(), chunk_index * chunk_size);
+                const size_t end = std::min(documents.size(), begin + chunk_size);
+                for (size_t i = begin; i < end; ++i) {
+                    chunk_tops[chunk_index].Push(documents[i]);
+                }
+            });
+        TopDocuments top(max_count, after);
+        for (const TopDocuments& chunk_top : chunk_tops) {
+            top.Merge(chunk_top);
+        }
+        return std::move(top).Extract();
+    } else {
+        TopDocuments top(max_count, after);
+        for (const Document& document : documents) {
+            top.Push(document);
+        }
+        return std::move(top).Extract();
+    }
+}